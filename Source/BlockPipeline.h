@@ -0,0 +1,283 @@
+/*
+  ==============================================================================
+
+    Pipelined processing for hosts with latency compensation. The host
+    callback only copies its block into an input ring and copies the output
+    for one block period earlier out of an output ring. A worker thread runs
+    the engine on everything in between, so a heavy block can take a whole
+    buffer period on another core. Both rings are indexed by sample time:
+    the output stays exactly one latency behind the input whatever block
+    sizes the host sends, and a late worker only costs silence, never a
+    shift.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include "RealtimeAudit.h"
+
+struct BlockPipeline : juce::Thread
+{
+    using Renderer = std::function<void(juce::AudioBuffer<float>&, juce::MidiBuffer&)>;
+
+    static constexpr int maxMidiEvents = 256;
+
+    // Ring length in blocks: the worker may fall this many blocks behind,
+    // less the one it is reading and the one the callback may write meanwhile
+    static constexpr int ringBlocks = 8;
+
+    explicit BlockPipeline(Renderer newRenderer)
+        : juce::Thread("Pipelined Engine"), renderer(std::move(newRenderer))
+    {
+    }
+
+    ~BlockPipeline() override
+    {
+        stopThread(1000);
+    }
+
+    // Not on the audio thread. The latency is the largest block the host sends.
+    void prepare(int newNumChannels, int newLatency)
+    {
+        stopThread(1000);
+
+        numChannels = juce::jmax(1, newNumChannels);
+        latency = juce::jmax(1, newLatency);
+        ringSize = ringBlocks * latency;
+
+        inputRing.setSize(numChannels, ringSize);
+        outputRing.setSize(numChannels, ringSize);
+        block.setSize(numChannels, latency);
+        inputRing.clear();
+        outputRing.clear();
+
+        blockMidi.clear();
+        blockMidi.ensureSize((size_t)maxMidiEvents * sizeof(MidiEvent));
+        midiFifo.reset();
+
+        inputWritten.store(0);
+        outputReady.store(0);
+        underruns.store(0);
+        processed = 0;
+
+        startThread(juce::Thread::Priority::highest);
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    int getLatency() const { return latency; }
+    int getUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+
+    // Audio thread: queues the block and replaces it with the output for one
+    // latency earlier. Offline the worker is waited for, so bounces are exact.
+    void exchange(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midi, bool waitForWorker)
+    {
+        auto numSamples = buffer.getNumSamples();
+        auto channelsToUse = juce::jmin(numChannels, buffer.getNumChannels());
+        auto start = inputWritten.load(std::memory_order_relaxed);
+
+        // Hosts must not send more than they were prepared for
+        jassert(numSamples <= latency);
+
+        for (const auto metadata : midi) {
+            if (metadata.numBytes <= 3)
+                pushMidi(metadata, start);
+        }
+
+        for (int channel = 0; channel < channelsToUse; ++channel) {
+            copyToRing(inputRing.getWritePointer(channel), buffer.getReadPointer(channel), start, numSamples);
+        }
+
+        inputWritten.store(start + numSamples, std::memory_order_release);
+
+        {
+            RealtimeAudit::ScopedExemption wakeUp;
+            notify();
+        }
+
+        auto first = start - latency;
+        auto needed = first + numSamples;
+
+        // Offline blocks have no deadline, so the audit lets this wait through
+        if (waitForWorker) {
+            RealtimeAudit::ScopedExemption offlineWait;
+
+            while (outputReady.load(std::memory_order_acquire) < needed && isThreadRunning())
+                rendered.wait(10);
+        }
+
+        // Before the first latency there is nothing to play yet, which is not an underrun
+        auto ready = outputReady.load(std::memory_order_acquire);
+        auto numLeading = (int)juce::jlimit((juce::int64)0, (juce::int64)numSamples, -first);
+        auto numReady = (int)juce::jlimit((juce::int64)numLeading, (juce::int64)numSamples, ready - first);
+
+        if (numReady < numSamples)
+            underruns.fetch_add(1, std::memory_order_relaxed);
+
+        for (int channel = 0; channel < channelsToUse; ++channel) {
+            auto* output = buffer.getWritePointer(channel);
+
+            juce::FloatVectorOperations::clear(output, numLeading);
+            copyFromRing(output + numLeading, outputRing.getReadPointer(channel), first + numLeading, numReady - numLeading);
+            juce::FloatVectorOperations::clear(output + numReady, numSamples - numReady);
+        }
+    }
+
+    // Sleeps until exchange() brings input; a notify that comes while a block
+    // renders keeps the event signalled, so no block is missed
+    void run() override
+    {
+        while (!threadShouldExit()) {
+            auto written = inputWritten.load(std::memory_order_acquire);
+
+            if (written == processed) {
+                wait(-1);
+                continue;
+            }
+
+            // Fell so far behind that the callback is overwriting unread input:
+            // give up on the backlog and play silence for it
+            if (written - processed > ringSize - 2 * latency)
+                skipTo(written);
+            else
+                renderNextBlock((int)juce::jmin((juce::int64)latency, written - processed));
+
+            rendered.signal();
+        }
+    }
+
+private:
+    // A short message and the input sample it lands on
+    struct MidiEvent
+    {
+        juce::int64 time;
+        juce::uint8 data[3];
+        int numBytes;
+    };
+
+    void pushMidi(const juce::MidiMessageMetadata& metadata, juce::int64 blockStart)
+    {
+        int start1, size1, start2, size2;
+        midiFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return;
+
+        auto& event = midiEvents[(size_t)start1];
+        event.time = blockStart + metadata.samplePosition;
+        event.numBytes = metadata.numBytes;
+        std::copy_n(metadata.data, metadata.numBytes, event.data);
+
+        midiFifo.finishedWrite(1);
+    }
+
+    // Events before the block start are late ones from a skipped backlog and land on its first sample
+    void collectMidi(juce::int64 blockStart, int numSamples)
+    {
+        blockMidi.clear();
+
+        for (;;) {
+            int start1, size1, start2, size2;
+            midiFifo.prepareToRead(1, start1, size1, start2, size2);
+
+            if (size1 == 0)
+                break;
+
+            auto& event = midiEvents[(size_t)start1];
+            if (event.time >= blockStart + numSamples)
+                break;
+
+            blockMidi.addEvent(event.data, event.numBytes, (int)juce::jmax((juce::int64)0, event.time - blockStart));
+            midiFifo.finishedRead(1);
+        }
+    }
+
+    void renderNextBlock(int numSamples)
+    {
+        juce::AudioBuffer<float> view(block.getArrayOfWritePointers(), numChannels, 0, numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            copyFromRing(view.getWritePointer(channel), inputRing.getReadPointer(channel), processed, numSamples);
+        }
+
+        collectMidi(processed, numSamples);
+        renderer(view, blockMidi);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            copyToRing(outputRing.getWritePointer(channel), view.getReadPointer(channel), processed, numSamples);
+        }
+
+        processed += numSamples;
+        outputReady.store(processed, std::memory_order_release);
+    }
+
+    // The callback only reads output it is still waiting for, none of which lies in the skipped range
+    void skipTo(juce::int64 written)
+    {
+        auto numSkipped = (int)juce::jmin((juce::int64)ringSize, written - processed);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto* output = outputRing.getWritePointer(channel);
+
+            for (juce::int64 time = written - numSkipped; time < written; ++time) {
+                output[time % ringSize] = 0.0f;
+            }
+        }
+
+        processed = written;
+        outputReady.store(processed, std::memory_order_release);
+    }
+
+    void copyToRing(float* ring, const float* source, juce::int64 time, int numSamples) const
+    {
+        auto position = (int)(time % ringSize);
+        auto size1 = juce::jmin(numSamples, ringSize - position);
+
+        std::copy_n(source, size1, ring + position);
+        std::copy_n(source + size1, numSamples - size1, ring);
+    }
+
+    void copyFromRing(float* destination, const float* ring, juce::int64 time, int numSamples) const
+    {
+        if (numSamples <= 0)
+            return;
+
+        auto position = (int)(time % ringSize);
+        auto size1 = juce::jmin(numSamples, ringSize - position);
+
+        std::copy_n(ring + position, size1, destination);
+        std::copy_n(ring, numSamples - size1, destination + size1);
+    }
+
+    Renderer renderer;
+
+    int numChannels = 1;
+    int latency = 1;
+    int ringSize = 4;
+
+    // Shared, indexed by sample time
+    juce::AudioBuffer<float> inputRing;
+    juce::AudioBuffer<float> outputRing;
+    std::atomic<juce::int64> inputWritten{ 0 };
+    std::atomic<juce::int64> outputReady{ 0 };
+    std::atomic<int> underruns{ 0 };
+
+    juce::AbstractFifo midiFifo{ maxMidiEvents };
+    std::array<MidiEvent, maxMidiEvents> midiEvents{};
+
+    // Signalled by the worker after each block, for offline callbacks waiting on it
+    juce::WaitableEvent rendered;
+
+    // Worker thread
+    juce::AudioBuffer<float> block;
+    juce::MidiBuffer blockMidi;
+    juce::int64 processed = 0;
+};
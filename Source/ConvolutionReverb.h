@@ -0,0 +1,598 @@
+/*
+  ==============================================================================
+
+    Convolution reverb for the direct and delayed sends, an alternative to
+    juce::Reverb driven by an impulse response loaded from disk.
+
+    The impulse response is split into non-uniform partitions so that there
+    is no added latency:
+      - the first 64 samples run as a direct FIR on the audio thread,
+      - up to 2048 samples, 64-sample FFT partitions run on the audio thread
+        each time 64 new input samples are in,
+      - the rest runs in 1024-sample FFT partitions on a background thread
+        at high priority.
+        The first of those starts 2048 samples into the impulse response, so
+        its output is first needed a whole partition after its input block
+        is complete. That period is the thread's head start.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <vector>
+#include "SimdKernels.h"
+#include "RealtimeAudit.h"
+
+// Uniformly partitioned overlap-save convolution of one channel. Each call
+// takes the next blockSize input samples and returns the convolution for
+// those same sample times.
+struct UniformConvolver
+{
+    // Allocates; never called on the audio thread
+    void prepare(const float* impulse, int impulseLength, int newBlockSize)
+    {
+        blockSize = newBlockSize;
+        fftSize = 2 * blockSize;
+        numBins = blockSize + 1;
+        numPartitions = (juce::jmax(0, impulseLength) + blockSize - 1) / blockSize;
+        current = 0;
+
+        fft = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2((double)fftSize)));
+        fftBuffer.assign((size_t)fftSize * 2, 0.0f);
+        window.assign((size_t)fftSize, 0.0f);
+        accumulator.assign((size_t)numBins, {});
+        filters.assign((size_t)(numPartitions * numBins), {});
+        spectra.assign((size_t)(numPartitions * numBins), {});
+
+        for (int partition = 0; partition < numPartitions; ++partition) {
+            std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+
+            auto start = partition * blockSize;
+            auto length = juce::jmin(blockSize, impulseLength - start);
+            std::copy(impulse + start, impulse + start + length, fftBuffer.begin());
+
+            fft->performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+            auto* bins = reinterpret_cast<const std::complex<float>*>(fftBuffer.data());
+            std::copy(bins, bins + numBins, filters.begin() + partition * numBins);
+        }
+    }
+
+    void reset()
+    {
+        std::fill(window.begin(), window.end(), 0.0f);
+        std::fill(spectra.begin(), spectra.end(), std::complex<float>());
+        current = 0;
+    }
+
+    bool isEmpty() const { return numPartitions == 0; }
+
+    void process(const float* input, float* output)
+    {
+        if (numPartitions == 0) {
+            juce::FloatVectorOperations::clear(output, blockSize);
+            return;
+        }
+
+        // The FFT window is the previous block followed by this one
+        std::copy(window.begin() + blockSize, window.end(), window.begin());
+        std::copy(input, input + blockSize, window.begin() + blockSize);
+
+        std::copy(window.begin(), window.end(), fftBuffer.begin());
+        std::fill(fftBuffer.begin() + fftSize, fftBuffer.end(), 0.0f);
+        fft->performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+        auto* bins = reinterpret_cast<std::complex<float>*>(fftBuffer.data());
+        std::copy(bins, bins + numBins, spectra.begin() + current * numBins);
+
+        // Newest input spectrum against the first partition, and so on back in time
+        std::fill(accumulator.begin(), accumulator.end(), std::complex<float>());
+        int slot = current;
+
+        for (int partition = 0; partition < numPartitions; ++partition) {
+            multiplyAccumulate(spectra.data() + slot * numBins, filters.data() + partition * numBins);
+            slot = (slot == 0) ? numPartitions - 1 : slot - 1;
+        }
+
+        current = (current + 1 == numPartitions) ? 0 : current + 1;
+
+        std::copy(accumulator.begin(), accumulator.end(), bins);
+        fft->performRealOnlyInverseTransform(fftBuffer.data());
+
+        // Overlap-save: only the second half is free of wrap-around
+        std::copy(fftBuffer.begin() + blockSize, fftBuffer.begin() + fftSize, output);
+    }
+
+private:
+    void multiplyAccumulate(const std::complex<float>* input, const std::complex<float>* filter)
+    {
+        auto* sums = reinterpret_cast<float*>(accumulator.data());
+        auto* x = reinterpret_cast<const float*>(input);
+        auto* h = reinterpret_cast<const float*>(filter);
+
+        for (int bin = 0; bin < numBins; ++bin) {
+            auto re = x[2 * bin] * h[2 * bin] - x[2 * bin + 1] * h[2 * bin + 1];
+            auto im = x[2 * bin] * h[2 * bin + 1] + x[2 * bin + 1] * h[2 * bin];
+            sums[2 * bin] += re;
+            sums[2 * bin + 1] += im;
+        }
+    }
+
+    int blockSize = 0, fftSize = 0, numBins = 0;
+    int numPartitions = 0;
+    int current = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> fftBuffer;
+    std::vector<float> window;
+    std::vector<std::complex<float>> accumulator;
+    std::vector<std::complex<float>> filters;
+    std::vector<std::complex<float>> spectra;
+};
+
+// One impulse response at one sample rate and channel count. Built off the
+// audio thread; its tail thread runs for as long as it exists.
+struct ConvolutionEngine : juce::Thread
+{
+    static constexpr int maxChannels = 2;
+    static constexpr int headBlockSize = 64;
+    static constexpr int tailBlockSize = 1024;
+    static constexpr int tailStart = 2 * tailBlockSize;
+    static constexpr int tailOutputSize = 4 * tailBlockSize;
+    static constexpr int tailInputSize = 16 * tailBlockSize;
+
+    ConvolutionEngine(const juce::AudioBuffer<float>& impulse, int newNumChannels, double sampleRate, const SimdKernels& newKernels)
+        : juce::Thread("Convolution Tail"), kernels(&newKernels)
+    {
+        numChannels = juce::jlimit(1, maxChannels, newNumChannels);
+        auto impulseLength = impulse.getNumSamples();
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& state = channels[(size_t)channel];
+            auto* ir = impulse.getReadPointer(juce::jmin(channel, impulse.getNumChannels() - 1));
+
+            state.direct.assign((size_t)headBlockSize, 0.0f);
+            std::copy(ir, ir + juce::jmin(headBlockSize, impulseLength), state.direct.begin());
+
+            state.head.prepare(ir + juce::jmin(headBlockSize, impulseLength),
+                juce::jlimit(0, tailStart - headBlockSize, impulseLength - headBlockSize), headBlockSize);
+            state.tail.prepare(ir + juce::jmin(tailStart, impulseLength), impulseLength - tailStart, tailBlockSize);
+
+            state.headInput.assign((size_t)headBlockSize * 2, 0.0f);
+            state.headOutput.assign((size_t)headBlockSize, 0.0f);
+            state.tailInput.assign((size_t)tailInputSize, 0.0f);
+            state.tailOutput.assign((size_t)tailOutputSize, 0.0f);
+            state.tailBlock.assign((size_t)tailBlockSize, 0.0f);
+            state.chunkOutput.assign((size_t)headBlockSize, 0.0f);
+        }
+
+        convolved.assign((size_t)headBlockSize, 0.0f);
+        dryGain.reset(sampleRate, 0.01);
+        wetGain.reset(sampleRate, 0.01);
+
+        hasTail = !channels[0].tail.isEmpty();
+        if (hasTail)
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    ~ConvolutionEngine() override
+    {
+        stopThread(1000);
+    }
+
+    // While the audio thread is stopped: back to silence, keeping the partitioned impulse response
+    void reset()
+    {
+        stopThread(1000);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& state = channels[(size_t)channel];
+
+            state.head.reset();
+            state.tail.reset();
+
+            for (auto* buffer : { &state.headInput, &state.headOutput, &state.chunkOutput,
+                                  &state.tailInput, &state.tailOutput, &state.tailBlock }) {
+                std::fill(buffer->begin(), buffer->end(), 0.0f);
+            }
+        }
+
+        headPosition = 0;
+        sampleTime = 0;
+        inputWritten.store(0);
+        tailReadyUpTo.store(tailStart);
+        nextTailBlockEnd = tailBlockSize;
+
+        if (hasTail)
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    // Audio thread: each channel becomes dry * dryLevel + wet * (the channel convolved with the IR),
+    // with the levels scaled the way juce::Reverb scales them. Returns the number of chunks whose
+    // tail part was not ready in time. Offline blocks have no deadline, so with waitForTail they
+    // hold until the tail thread catches up and a bounce never underruns.
+    int process(float* const* data, int numDataChannels, int numSamples, const juce::Reverb::Parameters& parameters, bool waitForTail)
+    {
+        auto activeChannels = juce::jmin(numDataChannels, numChannels);
+        auto firstSampleTime = sampleTime;
+        int numUnderruns = 0;
+
+        // The dry part must not fade in when the engine takes over
+        if (sampleTime == 0)
+            dryGain.setCurrentAndTargetValue(parameters.dryLevel * dryScaleFactor);
+
+        dryGain.setTargetValue(parameters.dryLevel * dryScaleFactor);
+        wetGain.setTargetValue(parameters.wetLevel);
+
+        for (int done = 0; done < numSamples;) {
+            auto numChunk = juce::jmin(numSamples - done, headBlockSize - headPosition);
+            auto tailReady = tailReadyUpTo.load(std::memory_order_acquire);
+
+            // The block this chunk needs ends at or before sampleTime, so its input is already in
+            if (waitForTail && hasTail && sampleTime + numChunk > tailReady) {
+                RealtimeAudit::ScopedExemption offlineWait;
+
+                while (tailReady < sampleTime + numChunk) {
+                    notify();
+                    tailProgress.wait(1);
+                    tailReady = tailReadyUpTo.load(std::memory_order_acquire);
+                }
+            }
+
+            bool smoothing = dryGain.isSmoothing() || wetGain.isSmoothing();
+
+            if (hasTail && sampleTime + numChunk > tailReady)
+                ++numUnderruns;
+
+            for (int channel = 0; channel < activeChannels; ++channel) {
+                auto* channelData = data[channel] + done;
+                auto& state = channels[(size_t)channel];
+                convolveChunk(state, channelData, numChunk, tailReady);
+
+                // The smoothed mix runs after all channels, so it needs each channel's result kept
+                if (smoothing)
+                    std::copy(convolved.begin(), convolved.begin() + numChunk, state.chunkOutput.begin());
+                else
+                    kernels->mix(channelData, channelData, dryGain.getTargetValue(), convolved.data(), wetGain.getTargetValue(), numChunk);
+            }
+
+            if (smoothing) {
+                for (int sample = 0; sample < numChunk; ++sample) {
+                    auto dry = dryGain.getNextValue();
+                    auto wet = wetGain.getNextValue();
+
+                    for (int channel = 0; channel < activeChannels; ++channel) {
+                        auto& state = channels[(size_t)channel];
+                        auto* channelData = data[channel] + done;
+                        channelData[sample] = channelData[sample] * dry + state.chunkOutput[(size_t)sample] * wet;
+                    }
+                }
+            }
+
+            headPosition += numChunk;
+            sampleTime += numChunk;
+            done += numChunk;
+
+            if (headPosition == headBlockSize) {
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    auto& state = channels[(size_t)channel];
+                    state.head.process(state.headInput.data() + headBlockSize, state.headOutput.data());
+                    std::copy(state.headInput.begin() + headBlockSize, state.headInput.end(), state.headInput.begin());
+                }
+
+                headPosition = 0;
+            }
+
+            inputWritten.store(sampleTime, std::memory_order_release);
+        }
+
+        // The tail thread sleeps until a whole tail block of input is in
+        if (hasTail && sampleTime / tailBlockSize != firstSampleTime / tailBlockSize) {
+            RealtimeAudit::ScopedExemption wakeUp;
+            notify();
+        }
+
+        return numUnderruns;
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit()) {
+            while (!threadShouldExit() && processNextTailBlock()) {}
+
+            wait(-1);
+        }
+    }
+
+private:
+    struct ChannelState
+    {
+        std::vector<float> direct;
+        UniformConvolver head;
+        UniformConvolver tail;
+
+        // Audio thread
+        std::vector<float> headInput;       // previous head block, then the one being filled
+        std::vector<float> headOutput;      // head partitions' output for the block being filled
+        std::vector<float> chunkOutput;
+
+        // Shared with the tail thread, indexed by sample time
+        std::vector<float> tailInput;
+        std::vector<float> tailOutput;
+
+        // Tail thread
+        std::vector<float> tailBlock;
+    };
+
+    // juce::Reverb scales its dry level by this
+    static constexpr float dryScaleFactor = 2.0f;
+
+    void convolveChunk(ChannelState& state, const float* input, int numSamples, juce::int64 tailReady)
+    {
+        auto* history = state.headInput.data() + headBlockSize + headPosition;
+        std::copy(input, input + numSamples, history);
+
+        auto tailIndex = (int)(sampleTime % tailInputSize);
+        auto firstPart = juce::jmin(numSamples, tailInputSize - tailIndex);
+        std::copy(input, input + firstPart, state.tailInput.begin() + tailIndex);
+        std::copy(input + firstPart, input + numSamples, state.tailInput.begin());
+
+        // Head partitions were computed at the last block boundary, the first 64 taps run here
+        std::copy(state.headOutput.begin() + headPosition, state.headOutput.begin() + headPosition + numSamples, convolved.begin());
+
+        for (int tap = 0; tap < headBlockSize; ++tap) {
+            kernels->addWithMultiply(convolved.data(), history - tap, state.direct[(size_t)tap], numSamples);
+        }
+
+        if (hasTail) {
+            auto numReady = (int)juce::jlimit((juce::int64)0, (juce::int64)numSamples, tailReady - sampleTime);
+
+            for (int sample = 0; sample < numReady; ++sample) {
+                convolved[(size_t)sample] += state.tailOutput[(size_t)((sampleTime + sample) % tailOutputSize)];
+            }
+        }
+    }
+
+    // Tail thread: one tail partition period per call, once its input is complete
+    bool processNextTailBlock()
+    {
+        auto written = inputWritten.load(std::memory_order_acquire);
+        if (written < nextTailBlockEnd)
+            return false;
+
+        // Fallen so far behind that the input ring has been overwritten: start again
+        // from the newest block. The tail glitches either way.
+        if (written - (nextTailBlockEnd - tailBlockSize) > tailInputSize - 2 * tailBlockSize) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                auto& state = channels[(size_t)channel];
+                state.tail.reset();
+                std::fill(state.tailOutput.begin(), state.tailOutput.end(), 0.0f);
+            }
+
+            nextTailBlockEnd = (written / tailBlockSize) * tailBlockSize;
+            tailReadyUpTo.store(nextTailBlockEnd + tailStart - tailBlockSize, std::memory_order_release);
+            return false;
+        }
+
+        auto blockStart = nextTailBlockEnd - tailBlockSize;
+        auto inputIndex = (int)(blockStart % tailInputSize);
+        auto outputIndex = (int)((blockStart + tailStart) % tailOutputSize);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& state = channels[(size_t)channel];
+
+            std::copy(state.tailInput.begin() + inputIndex, state.tailInput.begin() + inputIndex + tailBlockSize, state.tailBlock.begin());
+            state.tail.process(state.tailBlock.data(), state.tailOutput.data() + outputIndex);
+        }
+
+        tailReadyUpTo.store(blockStart + tailStart + tailBlockSize, std::memory_order_release);
+        nextTailBlockEnd += tailBlockSize;
+        tailProgress.signal();
+        return true;
+    }
+
+    int numChannels = 1;
+    const SimdKernels* kernels;
+    std::array<ChannelState, maxChannels> channels;
+    bool hasTail = false;
+
+    std::vector<float> convolved;
+    juce::SmoothedValue<float> dryGain, wetGain;
+    int headPosition = 0;
+    juce::int64 sampleTime = 0;
+
+    std::atomic<juce::int64> inputWritten{ 0 };
+    std::atomic<juce::int64> tailReadyUpTo{ tailStart };
+    juce::WaitableEvent tailProgress;
+    juce::int64 nextTailBlockEnd = tailBlockSize;
+};
+
+// Lowpasses an impulse response at 0.45 of targetRate before it is resampled down
+// to it, so nothing above the new Nyquist folds back. A Blackman-windowed sinc
+// whose length grows with the ratio, applied centred so the response keeps its timing.
+inline void lowpassBeforeDownsampling(juce::AudioBuffer<float>& buffer, double sourceRate, double targetRate)
+{
+    auto order = (size_t)(2 * juce::roundToInt(64.0 * sourceRate / targetRate));
+    auto design = juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod((float)(0.45 * targetRate), sourceRate, order,
+        juce::dsp::WindowingFunction<float>::blackman);
+
+    auto* taps = design->getRawCoefficients();
+    auto numTaps = (int)order + 1;
+    auto centre = (int)order / 2;
+    auto length = buffer.getNumSamples();
+
+    juce::AudioBuffer<float> filtered(buffer.getNumChannels(), length);
+    filtered.clear();
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        auto* input = buffer.getReadPointer(channel);
+        auto* output = filtered.getWritePointer(channel);
+
+        // output[n] += taps[tap] * input[n + tap - centre], one tap across the whole response at a time
+        for (int tap = 0; tap < numTaps; ++tap) {
+            auto shift = tap - centre;
+            auto first = juce::jmax(0, -shift);
+            auto last = juce::jmin(length, length - shift);
+
+            if (last > first)
+                juce::FloatVectorOperations::addWithMultiply(output + first, input + first + shift, taps[tap], last - first);
+        }
+    }
+
+    buffer = std::move(filtered);
+}
+
+// Message thread: reads an impulse response resampled to sampleRate, without its
+// trailing silence and scaled to unit energy, so the reverb level means the same
+// for every file
+inline bool readImpulseResponse(const juce::File& file, double sampleRate, juce::AudioBuffer<float>& destination)
+{
+    static constexpr double maxSeconds = 10.0;
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0 || sampleRate <= 0.0)
+        return false;
+
+    auto numChannels = juce::jmin(ConvolutionEngine::maxChannels, (int)reader->numChannels);
+    auto sourceLength = (int)juce::jmin(reader->lengthInSamples, (juce::int64)(maxSeconds * reader->sampleRate));
+
+    juce::AudioBuffer<float> source(numChannels, sourceLength);
+    reader->read(&source, 0, sourceLength, 0, true, numChannels > 1);
+
+    // The interpolator reads a few samples past the last one it is asked for
+    auto ratio = reader->sampleRate / sampleRate;
+    auto length = (ratio == 1.0) ? sourceLength : (int)((sourceLength - 4) / ratio);
+    if (length <= 0)
+        return false;
+
+    // Lagrange interpolation alone would fold the top of a higher-rate IR back down
+    if (ratio > 1.0)
+        lowpassBeforeDownsampling(source, reader->sampleRate, sampleRate);
+
+    destination.setSize(numChannels, length);
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        if (ratio == 1.0) {
+            destination.copyFrom(channel, 0, source, channel, 0, length);
+        }
+        else {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(ratio, source.getReadPointer(channel), destination.getWritePointer(channel), length);
+        }
+    }
+
+    auto peak = destination.getMagnitude(0, length);
+    if (peak <= 0.0f)
+        return false;
+
+    // Trailing samples below -100 dB relative to the peak only cost partitions
+    while (length > 1 && destination.getMagnitude(length - 1, 1) < peak * 1.0e-5f) {
+        --length;
+    }
+
+    destination.setSize(numChannels, length, true);
+
+    double energy = 0.0;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        auto* data = destination.getReadPointer(channel);
+        for (int sample = 0; sample < length; ++sample) {
+            energy += (double)data[sample] * data[sample];
+        }
+    }
+
+    destination.applyGain((float)(1.0 / std::sqrt(energy / numChannels)));
+    return true;
+}
+
+// Hands engines to the audio thread. New engines are built on the message
+// thread; the one they replace comes back through retired and is deleted
+// there, so the audio thread never frees memory or stops a thread.
+struct ConvolutionReverb
+{
+    ~ConvolutionReverb()
+    {
+        delete active;
+        delete pending.exchange(nullptr);
+        delete retired.exchange(nullptr);
+    }
+
+    // Message thread. A null engine switches back to the algorithmic reverb.
+    void setEngine(std::unique_ptr<ConvolutionEngine> engine)
+    {
+        delete pending.exchange(new Slot{ std::move(engine) });
+    }
+
+    // prepareToPlay, while the audio thread is stopped
+    void setEngineNow(std::unique_ptr<ConvolutionEngine> engine)
+    {
+        delete pending.exchange(nullptr);
+        delete retired.exchange(nullptr);
+        delete active;
+        active = new Slot{ std::move(engine) };
+        tailUnderruns.store(0);
+    }
+
+    // prepareToPlay, while the audio thread is stopped: keeps the newest engine and clears its state
+    void resetNow()
+    {
+        if (auto* next = pending.exchange(nullptr)) {
+            delete active;
+            active = next;
+        }
+
+        delete retired.exchange(nullptr);
+
+        if (active != nullptr && active->engine != nullptr)
+            active->engine->reset();
+
+        tailUnderruns.store(0);
+    }
+
+    // Message thread: frees an engine the audio thread has let go of
+    void collectGarbage()
+    {
+        delete retired.exchange(nullptr);
+    }
+
+    // Audio thread. Returns false without touching the audio when no impulse response is loaded.
+    bool process(float* const* data, int numChannels, int numSamples, const juce::Reverb::Parameters& parameters, bool waitForTail)
+    {
+        if (retired.load() == nullptr) {
+            if (auto* next = pending.exchange(nullptr)) {
+                retired.store(active);
+                active = next;
+            }
+        }
+
+        if (active == nullptr || active->engine == nullptr)
+            return false;
+
+        if (auto numUnderruns = active->engine->process(data, numChannels, numSamples, parameters, waitForTail))
+            tailUnderruns.fetch_add(numUnderruns, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // Any thread: chunks since the last prepareToPlay whose tail part was not ready in time
+    int getTailUnderruns() const { return tailUnderruns.load(std::memory_order_relaxed); }
+
+private:
+    // Never null once handed over, so null in the exchanges means "nothing waiting"
+    struct Slot
+    {
+        std::unique_ptr<ConvolutionEngine> engine;
+    };
+
+    Slot* active = nullptr;
+    std::atomic<Slot*> pending{ nullptr };
+    std::atomic<Slot*> retired{ nullptr };
+    std::atomic<int> tailUnderruns{ 0 };
+};
\ No newline at end of file
@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    Deadline-miss detector. processBlock measures its own wall-clock cost
+    against the real-time budget of the block (numSamples / sampleRate) and
+    counts the blocks that used more than half, 80% and all of it. The
+    worst blocks are kept with a snapshot of what the engine was running,
+    so a crackle report can be traced back to the settings behind it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "TripleBuffer.h"
+
+enum DeadlineThreshold
+{
+    DeadlineHalf,
+    DeadlineNear,
+    DeadlineMissed,
+    NumDeadlineThresholds
+};
+
+template <typename Snapshot>
+struct DeadlineMonitor
+{
+    static constexpr int numWorstBlocks = 8;
+
+    static float getThreshold(DeadlineThreshold threshold)
+    {
+        static constexpr float loads[NumDeadlineThresholds] = { 0.5f, 0.8f, 1.0f };
+        return loads[threshold];
+    }
+
+    struct BlockRecord
+    {
+        float load = 0.0f;              // cost / budget
+        double costMs = 0.0;
+        double budgetMs = 0.0;
+        int numSamples = 0;
+        juce::int64 samplePosition = 0;
+        juce::int64 blockNumber = 0;
+        Snapshot snapshot{};
+    };
+
+    // Worst first
+    struct WorstBlocks
+    {
+        std::array<BlockRecord, numWorstBlocks> blocks{};
+        int numBlocks = 0;
+    };
+
+    // Written by the audio thread, read anywhere
+    std::atomic<juce::int64> numBlocksMeasured{ 0 };
+    std::array<std::atomic<juce::int64>, NumDeadlineThresholds> counts{};
+    std::atomic<float> lastLoad{ 0.0f };
+    std::atomic<float> peakLoad{ 0.0f };
+
+    // Republished whenever the list changes; read from the message thread only
+    TripleBuffer<WorstBlocks> worstBlocks;
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+    }
+
+    // Message thread: the counters restart now, the worst list on the next block
+    void reset()
+    {
+        numBlocksMeasured.store(0);
+        for (auto& count : counts) {
+            count.store(0);
+        }
+
+        lastLoad.store(0.0f);
+        peakLoad.store(0.0f);
+        resetRequested.store(true);
+    }
+
+    // Audio thread
+    juce::int64 startBlock() const
+    {
+        return juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock(juce::int64 startTicks, int numSamples, juce::int64 samplePosition, const Snapshot& snapshot)
+    {
+        if (numSamples <= 0 || sampleRate <= 0.0)
+            return;
+
+        if (resetRequested.exchange(false)) {
+            current.numBlocks = 0;
+            publishWorstBlocks();
+        }
+
+        auto cost = (double)(juce::Time::getHighResolutionTicks() - startTicks) / ticksPerSecond;
+        auto budget = (double)numSamples / sampleRate;
+        auto load = (float)(cost / budget);
+
+        auto blockNumber = numBlocksMeasured.fetch_add(1, std::memory_order_relaxed);
+        lastLoad.store(load, std::memory_order_relaxed);
+
+        if (load > peakLoad.load(std::memory_order_relaxed))
+            peakLoad.store(load, std::memory_order_relaxed);
+
+        for (int threshold = 0; threshold < NumDeadlineThresholds; ++threshold) {
+            if (load > getThreshold((DeadlineThreshold)threshold))
+                counts[(size_t)threshold].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Blocks well inside the budget are not worth a snapshot
+        if (load <= getThreshold(DeadlineHalf))
+            return;
+
+        if (current.numBlocks == numWorstBlocks && load <= current.blocks[numWorstBlocks - 1].load)
+            return;
+
+        int position = juce::jmin(current.numBlocks, numWorstBlocks - 1);
+        while (position > 0 && current.blocks[(size_t)position - 1].load < load) {
+            current.blocks[(size_t)position] = current.blocks[(size_t)position - 1];
+            --position;
+        }
+
+        auto& record = current.blocks[(size_t)position];
+        record.load = load;
+        record.costMs = cost * 1000.0;
+        record.budgetMs = budget * 1000.0;
+        record.numSamples = numSamples;
+        record.samplePosition = samplePosition;
+        record.blockNumber = blockNumber;
+        record.snapshot = snapshot;
+
+        current.numBlocks = juce::jmin(current.numBlocks + 1, numWorstBlocks);
+        publishWorstBlocks();
+    }
+
+private:
+    void publishWorstBlocks()
+    {
+        worstBlocks.getWriteBuffer() = current;
+        worstBlocks.publish();
+    }
+
+    double sampleRate = 0.0;
+    double ticksPerSecond = 1.0;
+    std::atomic<bool> resetRequested{ false };
+    WorstBlocks current;
+};
\ No newline at end of file
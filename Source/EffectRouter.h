@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    Routing of the wet path through the modulation effects and the wet
+    reverb. A routing is described by the stage each effect sits in: effects
+    sharing a stage run in parallel on the stage input and are averaged,
+    stages run in series. Off the audio thread a routing is compiled into a
+    flat list of block operations, so the audio thread runs whole-block
+    kernels in sequence with no per-sample dispatch.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+enum RoutedEffect
+{
+    RoutedFlanger,
+    RoutedVibrato,
+    RoutedChorus,
+    RoutedWetReverb,
+    NumRoutedEffects
+};
+
+struct RoutingSpec
+{
+    static constexpr int maxStages = NumRoutedEffects;
+    static constexpr int bitsPerEffect = 4;
+
+    // 0 = not in the path, otherwise 1..maxStages
+    std::array<int, NumRoutedEffects> stages{};
+
+    // Packed into one word so the audio thread can pass it on through an atomic
+    juce::uint32 pack() const
+    {
+        juce::uint32 key = 0;
+        for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+            key |= (juce::uint32)juce::jlimit(0, maxStages, stages[(size_t)effect]) << (effect * bitsPerEffect);
+        }
+
+        return key;
+    }
+
+    static RoutingSpec unpack(juce::uint32 key)
+    {
+        RoutingSpec spec;
+        for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+            spec.stages[(size_t)effect] = (int)((key >> (effect * bitsPerEffect)) & ((1u << bitsPerEffect) - 1));
+        }
+
+        return spec;
+    }
+
+    // Takes the effects whose bit is set out of the path
+    RoutingSpec withBypass(juce::uint32 bypassMask) const
+    {
+        RoutingSpec spec = *this;
+        for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+            if ((bypassMask >> effect) & 1u)
+                spec.stages[(size_t)effect] = 0;
+        }
+
+        return spec;
+    }
+};
+
+struct RoutingProgram
+{
+    enum OpCode
+    {
+        SaveStageInput,     // stage input -> branch source
+        ProcessMain,        // run an effect in place on the wet path
+        ProcessBranch,      // branch source -> branch buffer, run an effect there
+        ScaleMain,          // wet path *= gain
+        AccumulateBranch    // wet path += branch buffer * gain
+    };
+
+    struct Op
+    {
+        OpCode code;
+        RoutedEffect effect;
+        float gain;
+    };
+
+    // A stage of k > 1 parallel effects takes 2k + 1 ops, a single effect one
+    static constexpr int maxOps = 3 * NumRoutedEffects;
+
+    std::array<Op, maxOps> ops{};
+    int numOps = 0;
+    juce::uint32 key = 0;
+
+    bool uses(RoutedEffect effect) const
+    {
+        return RoutingSpec::unpack(key).stages[(size_t)effect] != 0;
+    }
+
+    static RoutingProgram compile(const RoutingSpec& spec)
+    {
+        RoutingProgram program;
+        program.key = spec.pack();
+
+        for (int stage = 1; stage <= RoutingSpec::maxStages; ++stage) {
+            std::array<RoutedEffect, NumRoutedEffects> branches{};
+            int numBranches = 0;
+
+            for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+                if (spec.stages[(size_t)effect] == stage) {
+                    branches[(size_t)numBranches++] = (RoutedEffect)effect;
+                }
+            }
+
+            if (numBranches == 0)
+                continue;
+
+            if (numBranches == 1) {
+                program.add(ProcessMain, branches[0]);
+                continue;
+            }
+
+            auto branchGain = 1.0f / (float)numBranches;
+
+            program.add(SaveStageInput);
+            program.add(ProcessMain, branches[0]);
+            program.add(ScaleMain, branches[0], branchGain);
+
+            for (int branch = 1; branch < numBranches; ++branch) {
+                program.add(ProcessBranch, branches[(size_t)branch]);
+                program.add(AccumulateBranch, branches[(size_t)branch], branchGain);
+            }
+        }
+
+        return program;
+    }
+
+private:
+    void add(OpCode code, RoutedEffect effect = RoutedFlanger, float gain = 1.0f)
+    {
+        jassert(numOps < maxOps);
+        ops[(size_t)numOps++] = { code, effect, gain };
+    }
+};
+
+// Every bypass combination of one stage assignment, compiled together.
+// Bypass switches are the common change, and with all of them ready the
+// audio thread follows one at once instead of waiting for the timer; only
+// moving an effect to another stage needs a new compile.
+struct RoutingSet
+{
+    static constexpr int numBypassMasks = 1 << NumRoutedEffects;
+
+    std::array<RoutingProgram, numBypassMasks> programs{};
+    juce::uint32 stagesKey = 0;
+
+    const RoutingProgram& get(juce::uint32 bypassMask) const
+    {
+        return programs[(size_t)(bypassMask & (numBypassMasks - 1))];
+    }
+
+    static RoutingSet compile(const RoutingSpec& stageAssignment)
+    {
+        RoutingSet set;
+        set.stagesKey = stageAssignment.pack();
+
+        for (int bypassMask = 0; bypassMask < numBypassMasks; ++bypassMask) {
+            set.programs[(size_t)bypassMask] = RoutingProgram::compile(stageAssignment.withBypass((juce::uint32)bypassMask));
+        }
+
+        return set;
+    }
+};
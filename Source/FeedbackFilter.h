@@ -0,0 +1,312 @@
+/*
+  ==============================================================================
+
+    Tone shaping for the delay feedback path: a cascade of biquads in
+    transposed direct form II. Both channels share the coefficients and keep
+    their states side by side in one SIMD register, so L and R run through
+    each section in lockstep.
+
+    New settings glide: the cutoffs move in octaves and the shelf gain in dB
+    towards them with a 50 ms time constant, one step per block, and inside
+    a block the coefficients move in a straight line to those for the
+    block's end, so automation never steps the filter.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+
+struct FeedbackFilterSettings
+{
+    float highPassFreq{ 20.0f }, lowPassFreq{ 20000.0f }, shelfGain{ 0.0f };
+
+    bool operator== (const FeedbackFilterSettings& other) const
+    {
+        return highPassFreq == other.highPassFreq && lowPassFreq == other.lowPassFreq && shelfGain == other.shelfGain;
+    }
+};
+
+struct FeedbackFilter
+{
+    using Register = juce::dsp::SIMDRegister<float>;
+
+    static constexpr int maxChannels = 2;
+
+    // Sections at these settings are left out of the cascade
+    static constexpr float highPassOff = 20.0f;
+    static constexpr float lowPassOff = 20000.0f;
+    static constexpr float shelfFrequency = 4000.0f;
+
+    static constexpr double glideSeconds = 0.05;
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        coefficientsValid = false;
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& section : sections) {
+            section.s1 = Register::expand(0.0f);
+            section.s2 = Register::expand(0.0f);
+        }
+    }
+
+    // The first settings after prepare apply at once, later ones glide
+    void setSettings(const FeedbackFilterSettings& newSettings)
+    {
+        target = newSettings;
+
+        if (!coefficientsValid) {
+            settings = target;
+            coefficientsValid = true;
+            updateSections();
+        }
+    }
+
+    // Also true while a section still glides in or out of the cascade
+    bool isActive() const { return numActiveSections > 0 || !(settings == target); }
+
+    // True while the first two lanes hold the same state, as they do after
+    // running the same input through both
+    bool channelsMatch() const
+    {
+        for (int i = 0; i < numActiveSections; ++i) {
+            auto& section = sections[(size_t)activeSections[(size_t)i]];
+
+            if (section.s1.get(0) != section.s1.get(1) || section.s2.get(0) != section.s2.get(1))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Audio thread. Outputs may alias inputs.
+    void process(const float* const* inputs, float* const* outputs, int numChannels, int numSamples)
+    {
+        jassert(numChannels <= maxChannels);
+
+        if (settings == target) {
+            processSamples<false>(inputs, outputs, numChannels, numSamples);
+            return;
+        }
+
+        // Sections already running ramp from their current coefficients; sections
+        // joining start at their end ones, close to transparent
+        std::array<Coefficients, NumSectionTypes> from, ends;
+        for (size_t type = 0; type < sections.size(); ++type) {
+            from[type] = sections[type].coefficients;
+        }
+
+        auto previousOrder = activeSections;
+        auto previousActive = numActiveSections;
+
+        glide(numSamples);
+        updateSections();
+
+        auto rampScale = Register::expand(1.0f / (float)numSamples);
+
+        for (int i = 0; i < numActiveSections; ++i) {
+            auto type = activeSections[(size_t)i];
+            auto& section = sections[(size_t)type];
+            bool wasActive = std::find(previousOrder.begin(), previousOrder.begin() + previousActive, type) != previousOrder.begin() + previousActive;
+
+            ends[(size_t)type] = section.coefficients;
+
+            if (wasActive) {
+                auto& start = from[(size_t)type];
+                auto& end = ends[(size_t)type];
+
+                section.step = { (end.b0 - start.b0) * rampScale, (end.b1 - start.b1) * rampScale, (end.b2 - start.b2) * rampScale,
+                                 (end.a1 - start.a1) * rampScale, (end.a2 - start.a2) * rampScale };
+                section.coefficients = start;
+            }
+            else {
+                section.step = {};
+            }
+        }
+
+        processSamples<true>(inputs, outputs, numChannels, numSamples);
+
+        for (int i = 0; i < numActiveSections; ++i) {
+            auto type = activeSections[(size_t)i];
+            sections[(size_t)type].coefficients = ends[(size_t)type];
+        }
+    }
+
+private:
+    enum SectionType
+    {
+        HighPass,
+        HighShelf,
+        LowPass,
+        NumSectionTypes
+    };
+
+    struct Coefficients
+    {
+        Register b0, b1, b2, a1, a2;
+    };
+
+    struct Section
+    {
+        Coefficients coefficients, step;
+        Register s1, s2;
+    };
+
+    template <bool ramp>
+    void processSamples(const float* const* inputs, float* const* outputs, int numChannels, int numSamples)
+    {
+        for (int sample = 0; sample < numSamples; ++sample) {
+            auto x = Register::expand(0.0f);
+            for (int channel = 0; channel < numChannels; ++channel) {
+                x.set((size_t)channel, inputs[channel][sample]);
+            }
+
+            for (int i = 0; i < numActiveSections; ++i) {
+                auto& section = sections[(size_t)activeSections[(size_t)i]];
+                auto& c = section.coefficients;
+
+                if (ramp) {
+                    c.b0 += section.step.b0;
+                    c.b1 += section.step.b1;
+                    c.b2 += section.step.b2;
+                    c.a1 += section.step.a1;
+                    c.a2 += section.step.a2;
+                }
+
+                auto y = c.b0 * x + section.s1;
+                section.s1 = c.b1 * x - c.a1 * y + section.s2;
+                section.s2 = c.b2 * x - c.a2 * y;
+                x = y;
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                outputs[channel][sample] = x.get((size_t)channel);
+            }
+        }
+    }
+
+    // Moves the settings one block of numSamples towards the target, and onto it
+    // once the rest of the way could not be heard
+    void glide(int numSamples)
+    {
+        auto amount = 1.0 - std::exp(-(double)numSamples / (glideSeconds * sampleRate));
+
+        auto glideOctaves = [amount](float from, float to)
+            {
+                auto octaves = std::log2((double)from) + amount * (std::log2((double)to) - std::log2((double)from));
+                return (float)std::exp2(octaves);
+            };
+
+        settings.highPassFreq = glideOctaves(settings.highPassFreq, target.highPassFreq);
+        settings.lowPassFreq = glideOctaves(settings.lowPassFreq, target.lowPassFreq);
+        settings.shelfGain = (float)(settings.shelfGain + amount * (target.shelfGain - settings.shelfGain));
+
+        if (std::abs(std::log2(settings.highPassFreq / target.highPassFreq)) < 0.001f
+            && std::abs(std::log2(settings.lowPassFreq / target.lowPassFreq)) < 0.001f
+            && std::abs(settings.shelfGain - target.shelfGain) < 0.01f) {
+            settings = target;
+        }
+    }
+
+    void updateSections()
+    {
+        int previousActive = numActiveSections;
+        auto previousOrder = activeSections;
+        numActiveSections = 0;
+
+        if (settings.highPassFreq > highPassOff)
+            addSection(HighPass);
+        if (settings.shelfGain != 0.0f)
+            addSection(HighShelf);
+        if (settings.lowPassFreq < lowPassOff)
+            addSection(LowPass);
+
+        // Sections joining the cascade start from silence
+        for (int i = 0; i < numActiveSections; ++i) {
+            auto type = activeSections[(size_t)i];
+            if (std::find(previousOrder.begin(), previousOrder.begin() + previousActive, type) == previousOrder.begin() + previousActive) {
+                sections[(size_t)type].s1 = Register::expand(0.0f);
+                sections[(size_t)type].s2 = Register::expand(0.0f);
+            }
+        }
+    }
+
+    void addSection(SectionType type)
+    {
+        constexpr double q = 0.70710678118654752;
+        auto nyquistLimit = sampleRate * 0.45;
+
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+
+        switch (type) {
+            case HighPass: {
+                auto w0 = juce::MathConstants<double>::twoPi * juce::jmin((double)settings.highPassFreq, nyquistLimit) / sampleRate;
+                auto cosW0 = std::cos(w0);
+                auto alpha = std::sin(w0) / (2.0 * q);
+
+                b0 = (1.0 + cosW0) * 0.5;
+                b1 = -(1.0 + cosW0);
+                b2 = (1.0 + cosW0) * 0.5;
+                a0 = 1.0 + alpha;
+                a1 = -2.0 * cosW0;
+                a2 = 1.0 - alpha;
+                break;
+            }
+            case HighShelf: {
+                auto w0 = juce::MathConstants<double>::twoPi * juce::jmin((double)shelfFrequency, nyquistLimit) / sampleRate;
+                auto cosW0 = std::cos(w0);
+                auto A = std::pow(10.0, (double)settings.shelfGain / 40.0);
+                auto twoSqrtAAlpha = 2.0 * std::sqrt(A) * std::sin(w0) / (2.0 * q);
+
+                b0 = A * ((A + 1.0) + (A - 1.0) * cosW0 + twoSqrtAAlpha);
+                b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosW0);
+                b2 = A * ((A + 1.0) + (A - 1.0) * cosW0 - twoSqrtAAlpha);
+                a0 = (A + 1.0) - (A - 1.0) * cosW0 + twoSqrtAAlpha;
+                a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosW0);
+                a2 = (A + 1.0) - (A - 1.0) * cosW0 - twoSqrtAAlpha;
+                break;
+            }
+            case LowPass: {
+                auto w0 = juce::MathConstants<double>::twoPi * juce::jmin((double)settings.lowPassFreq, nyquistLimit) / sampleRate;
+                auto cosW0 = std::cos(w0);
+                auto alpha = std::sin(w0) / (2.0 * q);
+
+                b0 = (1.0 - cosW0) * 0.5;
+                b1 = 1.0 - cosW0;
+                b2 = (1.0 - cosW0) * 0.5;
+                a0 = 1.0 + alpha;
+                a1 = -2.0 * cosW0;
+                a2 = 1.0 - alpha;
+                break;
+            }
+            default:
+                break;
+        }
+
+        auto& coefficients = sections[(size_t)type].coefficients;
+        coefficients.b0 = Register::expand((float)(b0 / a0));
+        coefficients.b1 = Register::expand((float)(b1 / a0));
+        coefficients.b2 = Register::expand((float)(b2 / a0));
+        coefficients.a1 = Register::expand((float)(a1 / a0));
+        coefficients.a2 = Register::expand((float)(a2 / a0));
+
+        activeSections[(size_t)numActiveSections++] = type;
+    }
+
+    double sampleRate = 44100.0;
+    FeedbackFilterSettings settings;    // where the glide is
+    FeedbackFilterSettings target;
+    bool coefficientsValid = false;
+
+    std::array<Section, NumSectionTypes> sections{};
+    std::array<SectionType, NumSectionTypes> activeSections{};
+    int numActiveSections = 0;
+};
\ No newline at end of file
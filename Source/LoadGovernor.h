@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    Load governor. Watches the load processBlock measures against its
+    deadline and trades quality for headroom on live rigs: after a stretch of
+    blocks over half the budget it takes one step down, after a much longer
+    stretch under a quarter of it one step back up. Steps are taken in a
+    fixed order and undone in reverse, one hold period apart, so the cost of
+    a step shows up in the load before the next one is considered. A step
+    that takes a while to come into effect (the reverb rate crossfades)
+    counts as taken only once it has; the hold period starts from there.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// In the order they are taken
+enum GovernorStep
+{
+    GovernorFullQuality,
+    GovernorInterpolation,      // one interpolation kernel cheaper
+    GovernorLfoResolution,      // LFOs evaluated every 16 samples
+    GovernorReverbRate,         // reverbs one rate stage further down
+    NumGovernorSteps
+};
+
+struct LoadGovernor
+{
+    static constexpr int maxLevel = NumGovernorSteps - 1;
+
+    static constexpr float stepDownLoad = 0.5f;
+    static constexpr float stepUpLoad = 0.25f;
+    static constexpr double stepDownSeconds = 0.25;
+    static constexpr double stepUpSeconds = 4.0;
+
+    // Written by the audio thread, read anywhere
+    std::atomic<int> level{ GovernorFullQuality };
+
+    void prepare(double sampleRate)
+    {
+        stepDownSamples = (juce::int64)(stepDownSeconds * sampleRate);
+        stepUpSamples = (juce::int64)(stepUpSeconds * sampleRate);
+        reset();
+    }
+
+    void reset()
+    {
+        level.store(GovernorFullQuality);
+        samplesOver = 0;
+        samplesUnder = 0;
+    }
+
+    bool hasReached(GovernorStep step) const
+    {
+        return level.load(std::memory_order_relaxed) >= step;
+    }
+
+    // Audio thread, once per block with the load the deadline monitor measured.
+    // stepInEffect is false while the last step is still coming into effect.
+    void update(float load, int numSamples, bool stepInEffect)
+    {
+        if (!stepInEffect) {
+            samplesOver = 0;
+            samplesUnder = 0;
+            return;
+        }
+
+        auto current = level.load(std::memory_order_relaxed);
+
+        samplesOver = (load > stepDownLoad) ? samplesOver + numSamples : 0;
+        samplesUnder = (load < stepUpLoad) ? samplesUnder + numSamples : 0;
+
+        if (samplesOver >= stepDownSamples && current < maxLevel) {
+            level.store(current + 1, std::memory_order_relaxed);
+            samplesOver = 0;
+            samplesUnder = 0;
+        }
+        else if (samplesUnder >= stepUpSamples && current > GovernorFullQuality) {
+            level.store(current - 1, std::memory_order_relaxed);
+            samplesOver = 0;
+            samplesUnder = 0;
+        }
+    }
+
+private:
+    juce::int64 stepDownSamples = 0;
+    juce::int64 stepUpSamples = 0;
+    juce::int64 samplesOver = 0;
+    juce::int64 samplesUnder = 0;
+};
@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    Level meters and delay scope fed from the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+enum MeterStage
+{
+    Input,
+    DelayOut,
+    ModEffectOut,
+    ReverbOut,
+    Output,
+    NumMeterStages
+};
+
+struct LevelMeasurement
+{
+    float peak = 0.0f;
+    float sumOfSquares = 0.0f;
+    int numValues = 0;
+
+    void add(const float* data, int numSamples)
+    {
+        auto range = juce::FloatVectorOperations::findMinAndMax(data, numSamples);
+        peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+
+        // Four partial sums so the compiler can keep the loop in vector registers
+        float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+        int sample = 0;
+
+        for (; sample + 4 <= numSamples; sample += 4) {
+            sum0 += data[sample] * data[sample];
+            sum1 += data[sample + 1] * data[sample + 1];
+            sum2 += data[sample + 2] * data[sample + 2];
+            sum3 += data[sample + 3] * data[sample + 3];
+        }
+
+        for (; sample < numSamples; ++sample) {
+            sum0 += data[sample] * data[sample];
+        }
+
+        sumOfSquares += (sum0 + sum1) + (sum2 + sum3);
+        numValues += numSamples;
+    }
+
+    void add(const juce::AudioBuffer<float>& buffer, int numChannels, int numSamples)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            add(buffer.getReadPointer(channel), numSamples);
+        }
+    }
+
+    float getRms() const
+    {
+        return (numValues > 0) ? std::sqrt(sumOfSquares / (float)numValues) : 0.0f;
+    }
+};
+
+struct Metering
+{
+    static constexpr int scopeFifoSize = 1024;
+    static constexpr double scopePointsPerSecond = 100.0;
+    static constexpr int maxUnreadValues = 1 << 22;
+
+    // Accumulated over every block since the editor last read it
+    struct StageLevel
+    {
+        std::atomic<float> peak{ 0.0f };
+        std::atomic<float> sumOfSquares{ 0.0f };
+        std::atomic<int> numValues{ 0 };
+    };
+
+    std::array<StageLevel, NumMeterStages> levels;
+
+    void prepare(double sampleRate)
+    {
+        scopeDecimation = juce::jmax(1, (int)(sampleRate / scopePointsPerSecond));
+        scopeCounter = 0;
+        scopePeak = 0.0f;
+
+        for (auto& level : levels) {
+            level.peak.store(0.0f, std::memory_order_relaxed);
+            level.sumOfSquares.store(0.0f, std::memory_order_relaxed);
+            level.numValues.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Audio thread: adds to what the editor has not read yet, so a short
+    // peak between two repaints still reaches the meter
+    void publish(MeterStage stage, const LevelMeasurement& measurement)
+    {
+        auto& level = levels[stage];
+
+        auto peak = level.peak.load(std::memory_order_relaxed);
+        while (measurement.peak > peak && !level.peak.compare_exchange_weak(peak, measurement.peak, std::memory_order_relaxed)) {
+        }
+
+        // Nobody reads while the editor is closed: stop adding before the sums lose precision
+        if (level.numValues.load(std::memory_order_relaxed) > maxUnreadValues)
+            return;
+
+        auto sumOfSquares = level.sumOfSquares.load(std::memory_order_relaxed);
+        while (!level.sumOfSquares.compare_exchange_weak(sumOfSquares, sumOfSquares + measurement.sumOfSquares, std::memory_order_relaxed)) {
+        }
+
+        level.numValues.fetch_add(measurement.numValues, std::memory_order_release);
+    }
+
+    // Message thread: the peak and RMS since the last read, which starts the
+    // next period. False if no block arrived in between, so the meter holds.
+    // A block landing between the exchanges is split across two reads.
+    bool read(MeterStage stage, float& peak, float& rms)
+    {
+        auto& level = levels[stage];
+
+        auto numValues = level.numValues.exchange(0, std::memory_order_acquire);
+        if (numValues == 0)
+            return false;
+
+        peak = level.peak.exchange(0.0f, std::memory_order_relaxed);
+        rms = std::sqrt(juce::jmax(0.0f, level.sumOfSquares.exchange(0.0f, std::memory_order_relaxed)) / (float)numValues);
+        return true;
+    }
+
+    // Audio thread: one peak-hold point per decimation period, dropped if the GUI falls behind
+    void pushScope(const float* data, int numSamples)
+    {
+        for (int sample = 0; sample < numSamples; ++sample) {
+            scopePeak = juce::jmax(scopePeak, std::abs(data[sample]));
+
+            if (++scopeCounter >= scopeDecimation) {
+                int start1, size1, start2, size2;
+                scopeFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+                if (size1 > 0) {
+                    scopeData[(size_t)start1] = scopePeak;
+                }
+
+                scopeFifo.finishedWrite(size1 + size2);
+
+                scopeCounter = 0;
+                scopePeak = 0.0f;
+            }
+        }
+    }
+
+    // Message thread
+    int readScope(float* destination, int maxNumPoints)
+    {
+        int start1, size1, start2, size2;
+        scopeFifo.prepareToRead(maxNumPoints, start1, size1, start2, size2);
+
+        std::copy_n(scopeData.begin() + start1, size1, destination);
+        std::copy_n(scopeData.begin() + start2, size2, destination + size1);
+
+        scopeFifo.finishedRead(size1 + size2);
+        return size1 + size2;
+    }
+
+private:
+    juce::AbstractFifo scopeFifo{ scopeFifoSize };
+    std::array<float, scopeFifoSize> scopeData{};
+
+    int scopeDecimation = 1;
+    int scopeCounter = 0;
+    float scopePeak = 0.0f;
+};
@@ -0,0 +1,491 @@
+/*
+  ==============================================================================
+
+    Reverb at a reduced internal rate for high sample-rate sessions. The
+    damping in juce::Reverb removes the top octaves anyway, so at 96 kHz and
+    192 kHz the reverb runs at half or quarter rate behind polyphase
+    half-band decimators and interpolators and costs about what it does at
+    48 kHz. Only the wet tail goes through the resamplers; the dry part is
+    mixed back at the full rate. Below 88.2 kHz the reverb runs as before.
+
+    A path for every rate stands by. When the quality profile or the load
+    governor asks for another rate while input and tail are silent, the
+    reverb moves to that path at once. Otherwise the new path first runs
+    unheard until its tail has built up, then takes over with an
+    equal-power crossfade; both paths run only for that short stretch.
+
+    Setting MASTERSDELAY_REVERB_RATE (full, half, quarter) in the
+    environment caps the decimation for testing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "SimdKernels.h"
+
+// Half-band lowpass at a quarter of the input rate. Every other tap is zero
+// apart from the centre one (0.5), so a 2x decimator or interpolator splits
+// into two short polyphase branches.
+struct HalfBandCoefficients
+{
+    // Non-zero taps on each side of the centre: 4 * halfLength - 1 taps in all
+    static constexpr int halfLength = 12;
+
+    // taps[j] sits 2j + 1 samples away from the centre
+    std::array<float, halfLength> taps{};
+
+    HalfBandCoefficients()
+    {
+        // Kaiser-windowed sinc. At 96 kHz: flat to 20 kHz, 60 dB down above 28 kHz.
+        constexpr double beta = 6.0;
+        constexpr double centre = 2.0 * halfLength - 1.0;
+
+        auto besselI0 = [](double x)
+            {
+                double sum = 1.0, term = 1.0;
+                for (int k = 1; k < 32; ++k) {
+                    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                    sum += term;
+                }
+                return sum;
+            };
+
+        double sum = 0.0;
+        std::array<double, halfLength> values{};
+
+        for (int j = 0; j < halfLength; ++j) {
+            auto offset = 2.0 * j + 1.0;
+            auto ratio = offset / centre;
+            auto sinc = std::sin(juce::MathConstants<double>::halfPi * offset) / (juce::MathConstants<double>::pi * offset);
+
+            values[(size_t)j] = sinc * besselI0(beta * std::sqrt(1.0 - ratio * ratio)) / besselI0(beta);
+            sum += values[(size_t)j];
+        }
+
+        // Unity gain at DC: with the centre at 0.5, each side adds up to 0.25
+        for (int j = 0; j < halfLength; ++j) {
+            taps[(size_t)j] = (float)(values[(size_t)j] * 0.25 / sum);
+        }
+    }
+};
+
+// One channel of one 2x stage. decimate() and interpolate() are called in
+// pairs on the same span: the first takes it down to the low rate, the
+// second brings the processed low-rate samples back up. Both are causal and
+// accept any length up to maxBlock, odd ones included.
+struct HalfBandStage
+{
+    static constexpr int halfLength = HalfBandCoefficients::halfLength;
+    static constexpr int history = 2 * halfLength;
+    static constexpr int maxBlock = 256;
+    static constexpr int maxLowBlock = maxBlock / 2 + 1;
+
+    void reset()
+    {
+        evens.fill(0.0f);
+        odds.fill(0.0f);
+        lows.fill(0.0f);
+        oddPhase = false;
+        spanStartsOdd = false;
+        spanEvens = 0;
+    }
+
+    // Returns the number of low-rate samples written to output
+    int decimate(const float* input, int numSamples, float* output,
+        const HalfBandCoefficients& coefficients, const SimdKernels& kernels)
+    {
+        jassert(numSamples <= maxBlock);
+
+        spanStartsOdd = oddPhase;
+        int numEvens = 0, numOdds = 0;
+
+        for (int i = 0; i < numSamples; ++i) {
+            if (((i + (spanStartsOdd ? 1 : 0)) & 1) == 0)
+                evens[(size_t)(history + numEvens++)] = input[i];
+            else
+                odds[(size_t)(history + numOdds++)] = input[i];
+        }
+
+        // y[n] = 0.5 x[2n - centre] + sum of taps[j] * (x[2n - centre + 2j + 1] + x[2n - centre - 2j - 1])
+        auto* evenData = evens.data() + history - halfLength;
+        auto* oddData = odds.data() + history - halfLength + (spanStartsOdd ? 1 : 0);
+
+        juce::FloatVectorOperations::multiply(output, oddData, 0.5f, numEvens);
+
+        for (int j = 0; j < halfLength; ++j) {
+            auto tap = coefficients.taps[(size_t)j];
+            kernels.addWithMultiply(output, evenData + 1 + j, tap, numEvens);
+            kernels.addWithMultiply(output, evenData - j, tap, numEvens);
+        }
+
+        shiftHistory(evens, numEvens);
+        shiftHistory(odds, numOdds);
+
+        spanEvens = numEvens;
+        oddPhase = ((numSamples + (spanStartsOdd ? 1 : 0)) & 1) != 0;
+
+        return numEvens;
+    }
+
+    // input holds the low-rate samples for the span of the last decimate() call
+    void interpolate(const float* input, float* output, int numSamples,
+        const HalfBandCoefficients& coefficients, const SimdKernels& kernels)
+    {
+        std::copy(input, input + spanEvens, lows.begin() + history);
+
+        // Even outputs run the side taps, odd outputs take the centre tap.
+        // The zero-stuffed samples halve the level, so the taps are doubled.
+        auto* lowData = lows.data() + history - halfLength;
+        juce::FloatVectorOperations::clear(evenOutputs.data(), spanEvens);
+
+        for (int j = 0; j < halfLength; ++j) {
+            auto tap = 2.0f * coefficients.taps[(size_t)j];
+            kernels.addWithMultiply(evenOutputs.data(), lowData + 1 + j, tap, spanEvens);
+            kernels.addWithMultiply(evenOutputs.data(), lowData - j, tap, spanEvens);
+        }
+
+        auto* oddData = lowData + 1 - (spanStartsOdd ? 1 : 0);
+        int even = 0, odd = 0;
+
+        for (int i = 0; i < numSamples; ++i) {
+            if (((i + (spanStartsOdd ? 1 : 0)) & 1) == 0)
+                output[i] = evenOutputs[(size_t)even++];
+            else
+                output[i] = oddData[odd++];
+        }
+
+        shiftHistory(lows, spanEvens);
+    }
+
+private:
+    using HistoryArray = std::array<float, history + maxLowBlock>;
+
+    // Keeps the newest history samples at the front for the next span
+    static void shiftHistory(HistoryArray& data, int numNew)
+    {
+        std::copy(data.begin() + numNew, data.begin() + numNew + history, data.begin());
+    }
+
+    HistoryArray evens{};
+    HistoryArray odds{};
+    HistoryArray lows{};
+    std::array<float, maxLowBlock> evenOutputs{};
+
+    bool oddPhase = false;
+    bool spanStartsOdd = false;
+    int spanEvens = 0;
+};
+
+struct MultiRateReverb
+{
+    static constexpr int maxChannels = 2;
+    static constexpr int maxStages = 2;     // quarter rate
+    static constexpr int chunkSize = HalfBandStage::maxBlock;
+
+    // Input and tail below this (-100 dBFS) count as silence for a rate switch
+    static constexpr float silenceThreshold = 1.0e-5f;
+
+    // A switch with sound going on runs the new path unheard for this long,
+    // then crossfades over rateFadeSeconds
+    static constexpr double rateWarmUpSeconds = 0.2;
+    static constexpr double rateFadeSeconds = 0.2;
+
+    // Halves the rate while the internal rate stays at 44.1 kHz or above
+    static int chooseStages(double sampleRate)
+    {
+        int stages = 0;
+        while (stages < maxStages && sampleRate / (double)(2 << stages) >= 44099.0) {
+            ++stages;
+        }
+
+        return stages;
+    }
+
+    // The automatic choice, capped by MASTERSDELAY_REVERB_RATE if it is set
+    static int getRequestedStages(double sampleRate)
+    {
+        static const char* const rateNames[] = { "full", "half", "quarter" };
+        auto requested = juce::SystemStats::getEnvironmentVariable("MASTERSDELAY_REVERB_RATE", {}).trim().toLowerCase();
+        auto stages = chooseStages(sampleRate);
+
+        for (int cap = 0; cap <= maxStages; ++cap) {
+            if (requested == rateNames[cap])
+                return juce::jmin(stages, cap);
+        }
+
+        return stages;
+    }
+
+    // Prepares a path for every rate and starts on the one with newNumStages
+    void prepare(double sampleRate, int newNumStages, const SimdKernels& newKernels)
+    {
+        kernels = &newKernels;
+
+        for (int stages = 0; stages <= maxStages; ++stages) {
+            auto& path = paths[(size_t)stages];
+            path.numStages = stages;
+            path.reverb.setSampleRate(sampleRate / (double)(1 << stages));
+        }
+
+        dryGain.reset(sampleRate, 0.01);
+        dryGain.setCurrentAndTargetValue(parameters.dryLevel * dryScaleFactor);
+        warmUpLength = (int)(rateWarmUpSeconds * sampleRate);
+        fadeLength = juce::jmax(1, (int)(rateFadeSeconds * sampleRate));
+
+        setParameters(parameters);
+        activeStages = targetStages = juce::jlimit(0, maxStages, newNumStages);
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& path : paths) {
+            path.reset();
+        }
+
+        activeStages = targetStages;
+        nextStages = -1;
+    }
+
+    void setParameters(const juce::Reverb::Parameters& newParameters)
+    {
+        parameters = newParameters;
+
+        // The dry part is mixed here at the full rate, whichever path runs
+        auto wetOnly = parameters;
+        wetOnly.dryLevel = 0.0f;
+
+        for (auto& path : paths) {
+            path.reverb.setParameters(wetOnly);
+        }
+
+        dryGain.setTargetValue(parameters.dryLevel * dryScaleFactor);
+    }
+
+    int getNumStages() const { return activeStages; }
+
+    // True once the rate last asked for is the only one running
+    bool isSettled() const { return activeStages == targetStages && nextStages < 0; }
+
+    // Audio thread. The rate changes at once if input and tail are silent,
+    // otherwise through a warm-up and a crossfade. A request made while a
+    // switch runs is taken up once it has finished.
+    void setStages(int newNumStages)
+    {
+        targetStages = juce::jlimit(0, maxStages, newNumStages);
+    }
+
+    // Audio thread. Moves to the rate straight away, dropping any switch that
+    // runs, for renders whose output must not depend on when a switch lands.
+    // A path that was not running starts from silence.
+    void setStagesNow(int newNumStages)
+    {
+        targetStages = juce::jlimit(0, maxStages, newNumStages);
+
+        if (isSettled())
+            return;
+
+        if (targetStages != activeStages)
+            paths[(size_t)targetStages].reset();
+
+        activeStages = targetStages;
+        nextStages = -1;
+    }
+
+    void processMono(float* samples, int numSamples)
+    {
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            float* channels[] = { samples + start };
+            processChunk(channels, 1, juce::jmin(chunkSize, numSamples - start));
+        }
+    }
+
+    void processStereo(float* left, float* right, int numSamples)
+    {
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            float* channels[] = { left + start, right + start };
+            processChunk(channels, 2, juce::jmin(chunkSize, numSamples - start));
+        }
+    }
+
+private:
+    // juce::Reverb scales its dry level by this
+    static constexpr float dryScaleFactor = 2.0f;
+
+    // A reverb and the resamplers around it
+    struct RatePath
+    {
+        juce::Reverb reverb;
+        int numStages = 0;
+        std::array<std::array<HalfBandStage, maxStages>, maxChannels> stages;
+
+        void reset()
+        {
+            reverb.reset();
+
+            for (auto& channelStages : stages) {
+                for (auto& stage : channelStages) {
+                    stage.reset();
+                }
+            }
+        }
+    };
+
+    using ChunkBuffers = std::array<std::array<float, chunkSize>, maxChannels>;
+
+    // Writes the wet signal of one path for the chunk into wet
+    void processPath(RatePath& path, float* const* channels, int numChannels, int numSamples, ChunkBuffers& wet)
+    {
+        if (path.numStages == 0) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                std::copy(channels[channel], channels[channel] + numSamples, wet[(size_t)channel].begin());
+            }
+
+            if (numChannels == 1)
+                path.reverb.processMono(wet[0].data(), numSamples);
+            else
+                path.reverb.processStereo(wet[0].data(), wet[1].data(), numSamples);
+
+            return;
+        }
+
+        std::array<int, maxStages + 1> counts{};
+        counts[0] = numSamples;
+
+        for (int stage = 0; stage < path.numStages; ++stage) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const float* input = (stage == 0) ? channels[channel] : lowBuffers[(size_t)stage - 1][(size_t)channel].data();
+                counts[(size_t)stage + 1] = path.stages[(size_t)channel][(size_t)stage].decimate(input, counts[(size_t)stage],
+                    lowBuffers[(size_t)stage][(size_t)channel].data(), coefficients, *kernels);
+            }
+        }
+
+        auto& lowest = lowBuffers[(size_t)path.numStages - 1];
+        auto numLow = counts[(size_t)path.numStages];
+
+        if (numChannels == 1)
+            path.reverb.processMono(lowest[0].data(), numLow);
+        else
+            path.reverb.processStereo(lowest[0].data(), lowest[1].data(), numLow);
+
+        for (int stage = path.numStages; --stage >= 0;) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* output = (stage == 0) ? wet[(size_t)channel].data() : lowBuffers[(size_t)stage - 1][(size_t)channel].data();
+                path.stages[(size_t)channel][(size_t)stage].interpolate(lowBuffers[(size_t)stage][(size_t)channel].data(), output,
+                    counts[(size_t)stage], coefficients, *kernels);
+            }
+        }
+    }
+
+    void processChunk(float* const* channels, int numChannels, int numSamples)
+    {
+        // Only looked at while a rate change is waiting to start
+        bool switchWaiting = nextStages < 0 && activeStages != targetStages;
+        bool inputSilent = switchWaiting && isSilent(channels, numChannels, numSamples);
+
+        auto& wet = wetBuffers[0];
+        processPath(paths[(size_t)activeStages], channels, numChannels, numSamples, wet);
+
+        if (switchWaiting) {
+            float* wetChannels[] = { wet[0].data(), wet[1].data() };
+
+            // Nothing going in and nothing left ringing: the other path starts from
+            // silence too, so switching now cannot be heard
+            if (inputSilent && isSilent(wetChannels, numChannels, numSamples)) {
+                paths[(size_t)targetStages].reset();
+                activeStages = targetStages;
+            }
+            else {
+                paths[(size_t)targetStages].reset();
+                nextStages = targetStages;
+                switchPosition = 0;
+            }
+        }
+        else if (nextStages >= 0) {
+            processSwitch(channels, numChannels, numSamples);
+        }
+
+        // Dry part at the full rate, ramped like juce::Reverb ramps it
+        if (dryGain.isSmoothing()) {
+            for (int sample = 0; sample < numSamples; ++sample) {
+                auto gain = dryGain.getNextValue();
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    channels[channel][sample] = channels[channel][sample] * gain + wet[(size_t)channel][(size_t)sample];
+                }
+            }
+        }
+        else {
+            auto gain = dryGain.getTargetValue();
+            for (int channel = 0; channel < numChannels; ++channel) {
+                kernels->mix(channels[channel], channels[channel], gain, wet[(size_t)channel].data(), 1.0f, numSamples);
+            }
+        }
+    }
+
+    // Runs the path being switched to next to the active one. It stays unheard
+    // while its tail builds up, then an equal-power crossfade hands over to it:
+    // the two tails are uncorrelated.
+    void processSwitch(float* const* channels, int numChannels, int numSamples)
+    {
+        auto& wet = wetBuffers[0];
+        auto& incoming = wetBuffers[1];
+        processPath(paths[(size_t)nextStages], channels, numChannels, numSamples, incoming);
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            auto fadePosition = switchPosition + sample - warmUpLength;
+
+            if (fadePosition < 0)
+                continue;
+
+            auto angle = juce::MathConstants<float>::halfPi * (float)juce::jmin(fadePosition, fadeLength) / (float)fadeLength;
+            auto gainIn = std::sin(angle);
+            auto gainOut = std::cos(angle);
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                wet[(size_t)channel][(size_t)sample] = wet[(size_t)channel][(size_t)sample] * gainOut
+                    + incoming[(size_t)channel][(size_t)sample] * gainIn;
+            }
+        }
+
+        switchPosition += numSamples;
+
+        if (switchPosition >= warmUpLength + fadeLength) {
+            activeStages = nextStages;
+            nextStages = -1;
+        }
+    }
+
+    static bool isSilent(const float* const* channels, int numChannels, int numSamples)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto range = juce::FloatVectorOperations::findMinAndMax(channels[channel], numSamples);
+
+            if (range.getStart() < -silenceThreshold || range.getEnd() > silenceThreshold)
+                return false;
+        }
+
+        return true;
+    }
+
+    std::array<RatePath, maxStages + 1> paths;
+    int activeStages = 0;
+    int targetStages = 0;
+    int nextStages = -1;        // the path a running switch moves to
+    int switchPosition = 0;
+    int warmUpLength = 0;
+    int fadeLength = 1;
+
+    juce::Reverb::Parameters parameters;
+    juce::SmoothedValue<float> dryGain;
+
+    const SimdKernels* kernels = &getSimdKernels(SimdBaseline);
+    HalfBandCoefficients coefficients;
+
+    std::array<std::array<std::array<float, HalfBandStage::maxLowBlock>, maxChannels>, maxStages> lowBuffers{};
+    std::array<ChunkBuffers, 2> wetBuffers{};
+};
@@ -0,0 +1,217 @@
+/*
+  ==============================================================================
+
+    Ring buffer made of fixed-size pages. Only the pages needed for the
+    current delay setting are allocated. The ring grows by splitting the
+    write page at the write head and inserting fresh pages into the split,
+    which keeps every delay distance intact.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct PagedDelayBuffer
+{
+    // Not on the audio thread. Allocates enough pages for initialLength. With
+    // the same layout as last time the pages already allocated are kept and
+    // only zeroed, so a transport restart costs no allocations.
+    void prepare(int numberOfChannels, int maxLength, int initialLength, int newPageShift)
+    {
+        const juce::ScopedLock sl(allocationLock);
+
+        auto newNumChannels = juce::jmax(1, numberOfChannels);
+        auto newMaxPages = juce::jmax(1, (maxLength + (1 << newPageShift) - 1) >> newPageShift);
+
+        if (pagePool != nullptr && newNumChannels == numChannels && newPageShift == pageShift && newMaxPages == maxPages) {
+            reuseAllocatedPages();
+            requestedPages.store(juce::jmax(numAllocatedPages.load(), getPagesForLength(initialLength)));
+            allocateRequestedPages();
+            commitReadyPages(0);
+            return;
+        }
+
+        numChannels = newNumChannels;
+        pageShift = newPageShift;
+        pageSize = 1 << pageShift;
+        maxPages = newMaxPages;
+
+        pagePool.reset(new juce::HeapBlock<float>[(size_t)(maxPages * numChannels)]);
+        numAllocatedPages.store(0);
+        numActivePages = 0;
+
+        ring.resize((size_t)numChannels);
+        for (auto& channelPages : ring) {
+            channelPages.clear();
+            channelPages.reserve((size_t)maxPages);
+        }
+
+        requestedPages.store(getPagesForLength(initialLength));
+        allocateRequestedPages();
+        commitReadyPages(0);
+    }
+
+    // Not on the audio thread. Gives every page back; prepare starts over.
+    void release()
+    {
+        const juce::ScopedLock sl(allocationLock);
+
+        pagePool.reset();
+        numAllocatedPages.store(0);
+        requestedPages.store(0);
+        numActivePages = 0;
+
+        ring.clear();
+        ring.shrink_to_fit();
+    }
+
+    // Not on the audio thread, unless rendering offline
+    void allocateRequestedPages()
+    {
+        const juce::ScopedLock sl(allocationLock);
+
+        auto allocated = numAllocatedPages.load();
+        auto requested = juce::jmin(requestedPages.load(), maxPages);
+
+        for (; allocated < requested; ++allocated) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                // calloc hands back fresh zero pages for large blocks
+                pagePool[(size_t)(allocated * numChannels + channel)].calloc((size_t)pageSize);
+            }
+
+            numAllocatedPages.store(allocated + 1, std::memory_order_release);
+        }
+    }
+
+    // Audio thread
+    void requestLength(int length)
+    {
+        auto pages = getPagesForLength(length);
+
+        if (pages > numActivePages && pages > requestedPages.load(std::memory_order_relaxed)) {
+            requestedPages.store(pages, std::memory_order_relaxed);
+        }
+    }
+
+    bool hasPendingRequest() const
+    {
+        return requestedPages.load(std::memory_order_relaxed) > numAllocatedPages.load(std::memory_order_relaxed);
+    }
+
+    // Audio thread, between blocks. New pages go after the page holding the
+    // write position. That page's samples from the write position on are the
+    // oldest history; they move to the same offsets in the last new page, so
+    // every sample behind the write head keeps its distance and the write
+    // page is silent from there on, like the new pages.
+    void commitReadyPages(int writePosition)
+    {
+        auto allocated = numAllocatedPages.load(std::memory_order_acquire);
+        if (allocated <= numActivePages)
+            return;
+
+        auto insertIndex = (numActivePages == 0) ? 0 : (writePosition >> pageShift) + 1;
+        auto offset = writePosition & (pageSize - 1);
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& channelPages = ring[(size_t)channel];
+
+            for (int page = numActivePages; page < allocated; ++page) {
+                channelPages.insert(channelPages.begin() + insertIndex + (page - numActivePages),
+                    pagePool[(size_t)(page * numChannels + channel)].get());
+            }
+
+            if (numActivePages > 0) {
+                auto* writePage = channelPages[(size_t)insertIndex - 1];
+                auto* lastNewPage = channelPages[(size_t)(insertIndex + allocated - numActivePages - 1)];
+
+                juce::FloatVectorOperations::copy(lastNewPage + offset, writePage + offset, pageSize - offset);
+                juce::FloatVectorOperations::clear(writePage + offset, pageSize - offset);
+            }
+        }
+
+        numActivePages = allocated;
+    }
+
+    int getLength() const { return numActivePages << pageShift; }
+    int getPageShift() const { return pageShift; }
+    float* const* getPages(int channel) const { return ring[(size_t)channel].data(); }
+
+    void clear()
+    {
+        for (auto& channelPages : ring) {
+            for (auto* page : channelPages) {
+                juce::FloatVectorOperations::clear(page, pageSize);
+            }
+        }
+    }
+
+    static int getPageShiftForLength(int length)
+    {
+        int shift = 0;
+        while ((1 << shift) < length)
+            ++shift;
+
+        return shift;
+    }
+
+private:
+    int getPagesForLength(int length) const
+    {
+        return juce::jlimit(1, maxPages, (length + pageSize - 1) >> pageShift);
+    }
+
+    // Pages this large come straight from the OS, so handing them back and
+    // calloc'ing them again maps fresh zero pages instead of writing zeros
+    // through every byte; the OS zeroes them when they are first touched.
+    static constexpr size_t freshZeroPageBytes = 128 * 1024;
+
+    // Zeroes the allocated pages and puts them back in pool order; any order
+    // is a valid ring once every sample is zero.
+    void reuseAllocatedPages()
+    {
+        auto allocated = numAllocatedPages.load();
+        auto useFreshPages = (size_t)pageSize * sizeof(float) >= freshZeroPageBytes;
+
+        for (int page = 0; page < allocated * numChannels; ++page) {
+            auto& block = pagePool[(size_t)page];
+
+            if (useFreshPages) {
+                block.free();
+                block.calloc((size_t)pageSize);
+            }
+            else {
+                juce::FloatVectorOperations::clear(block.get(), pageSize);
+            }
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            auto& channelPages = ring[(size_t)channel];
+            channelPages.clear();
+
+            for (int page = 0; page < allocated; ++page) {
+                channelPages.push_back(pagePool[(size_t)(page * numChannels + channel)].get());
+            }
+        }
+
+        numActivePages = allocated;
+    }
+
+    int numChannels = 1;
+    int pageShift = 0;
+    int pageSize = 1;
+    int maxPages = 1;
+
+    std::unique_ptr<juce::HeapBlock<float>[]> pagePool;
+    std::atomic<int> numAllocatedPages{ 0 };
+    std::atomic<int> requestedPages{ 0 };
+    juce::CriticalSection allocationLock;
+
+    // Audio thread owned: page order of the ring, per channel
+    std::vector<std::vector<float*>> ring;
+    int numActivePages = 0;
+};
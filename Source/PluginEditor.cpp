@@ -9,6 +9,80 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    struct SliderSpec
+    {
+        const char* parameterID;
+        const char* suffix;
+        const char* minLabel;
+        const char* title;
+        const char* maxLabel;
+        bool showPercentage;
+    };
+
+    const SliderSpec sliderSpecs[] =
+    {
+        { "Delay Time", "ms", "0.1s", "Delay Time", "60s", false },
+        { "Feedback", " ", "0%", "Feedback", "100%", true },
+        { "Dry Level", " ", "0%", "Dry Amount", "100%", true },
+        { "Wet Level", " ", "0%", "Wet Amount", "100%", true },
+
+        { "Flanger Delay", "ms", "1ms", "Delay Time", "20ms", false },
+        { "Flanger Width", "ms", "1ms", "Width", "20ms", false },
+        { "Flanger Depth", " ", "0%", "Amount", "100%", true },
+        { "Flanger Feedback", " ", "0%", "Feedback", "100%", true },
+        { "Flanger LFO Frequency", "Hz", "0.1Hz", "Rate", "2.0Hz", false },
+
+        { "Vibrato Width", "ms", "1ms", "Width", "40ms", false },
+        { "Vibrato Depth", " ", "0%", "Amount", "100%", true },
+        { "Vibrato LFO Frequency", "Hz", "0.4Hz", "Rate", "8Hz", false },
+
+        { "Chorus Delay", "ms", "10ms", "Delay Time", "50ms", false },
+        { "Chorus Width", "ms", "1ms", "Width", "30ms", false },
+        { "Chorus Depth", " ", "0%", "Amount", "100%", true },
+        { "Chorus LFO Frequency", "Hz", "0.1Hz", "Rate", "2.0Hz", false },
+        { "Number of Voices", "Voices", "2", "Voices", "5", false },
+
+        { "Dry Reverb", " ", "0%", "Direct Reverb Amount", "100%", true },
+        { "Wet Reverb", " ", "0%", "Delayed Reverb Amount", "100%", true },
+        { "Room Size", " ", "0%", "Room Size", "100%", true },
+        { "Damping", " ", "0%", "Damping", "100%", true },
+        { "Reverb Width", " ", "0%", "Width", "100%", true },
+
+        { "Delay Mode", "", "Clean", "Delay Mode", "Granular", false },
+        { "Grain Pitch", "st", "-24st", "Grain Pitch", "+24st", false },
+        { "Grain Size", "ms", "20ms", "Grain Size", "500ms", false },
+        { "Grain Density", "Grains", "1", "Density", "128", false },
+        { "Grain Spray", "ms", "0ms", "Spray", "250ms", false }
+    };
+
+    const SliderSpec& findSliderSpec(const juce::String& parameterID)
+    {
+        for (auto& spec : sliderSpecs)
+        {
+            if (parameterID == spec.parameterID)
+                return spec;
+        }
+
+        jassertfalse;
+        return sliderSpecs[0];
+    }
+}
+
+void LookAndFeel::drawRotarySliderBody(juce::Graphics& g,
+    juce::Rectangle<float> bounds,
+    bool enabled)
+{
+    using namespace juce;
+
+    g.setColour(enabled ? Colour(255u, 126u, 13u) : Colours::darkgrey);
+    g.fillEllipse(bounds);
+
+    g.setColour(enabled ? Colour(207u, 34u, 0u) : Colours::grey);
+    g.drawEllipse(bounds, 2.f);
+}
+
 void LookAndFeel::drawRotarySlider(juce::Graphics& g,
     int x,
     int y,
@@ -25,47 +99,47 @@ void LookAndFeel::drawRotarySlider(juce::Graphics& g,
 
     auto enabled = slider.isEnabled();
 
-    g.setColour(enabled ? Colour(255u, 126u, 13u) : Colours::darkgrey);
-    g.fillEllipse(bounds);
+    // The body of a RotarySliderWithLabels comes from its cached static layer
+    auto* rswl = dynamic_cast<RotarySliderWithLabels*>(&slider);
 
-    g.setColour(enabled ? Colour(207u, 34u, 0u) : Colours::grey);
-    g.drawEllipse(bounds, 2.f);
+    if (rswl == nullptr) {
+        drawRotarySliderBody(g, bounds, enabled);
+        return;
+    }
 
-    if (auto* rswl = dynamic_cast<RotarySliderWithLabels*>(&slider))
-    {
-        auto center = bounds.getCentre();
+    auto center = bounds.getCentre();
 
-        Path p;
+    Path p;
 
-        Rectangle<float> r;
-        r.setLeft(center.getX() - 2);
-        r.setRight(center.getX() + 2);
-        r.setTop(bounds.getY());
-        r.setBottom(center.getY() - rswl->getTextHeight() * 1.5);
+    Rectangle<float> r;
+    r.setLeft(center.getX() - 2);
+    r.setRight(center.getX() + 2);
+    r.setTop(bounds.getY());
+    r.setBottom(center.getY() - rswl->getTextHeight() * 1.5);
 
-        p.addRoundedRectangle(r, 2.f);
+    p.addRoundedRectangle(r, 2.f);
 
-        jassert(rotaryStartAngle < rotaryEndAngle);
+    jassert(rotaryStartAngle < rotaryEndAngle);
 
-        auto sliderAngRad = jmap(sliderPosProportional, 0.f, 1.f, rotaryStartAngle, rotaryEndAngle);
+    auto sliderAngRad = jmap(sliderPosProportional, 0.f, 1.f, rotaryStartAngle, rotaryEndAngle);
 
-        p.applyTransform(AffineTransform().rotated(sliderAngRad, center.getX(), center.getY()));
+    p.applyTransform(AffineTransform().rotated(sliderAngRad, center.getX(), center.getY()));
 
-        g.fillPath(p);
+    g.setColour(enabled ? Colour(207u, 34u, 0u) : Colours::grey);
+    g.fillPath(p);
 
-        g.setFont(rswl->getTextHeight());
-        auto text = rswl->getDisplayString();
-        auto strWidth = g.getCurrentFont().getStringWidth(text);
+    g.setFont(rswl->getTextHeight());
+    auto text = rswl->getDisplayString();
+    auto strWidth = g.getCurrentFont().getStringWidth(text);
 
-        r.setSize(strWidth + 4, rswl->getTextHeight() + 2);
-        r.setCentre(center);
+    r.setSize(strWidth + 4, rswl->getTextHeight() + 2);
+    r.setCentre(center);
 
-        g.setColour(enabled ? Colours::black : Colours::darkgrey);
-        g.fillRect(r);
+    g.setColour(enabled ? Colours::black : Colours::darkgrey);
+    g.fillRect(r);
 
-        g.setColour(enabled ? Colours::white : Colours::lightgrey);
-        g.drawFittedText(text, r.toNearestInt(), juce::Justification::centred, 1);
-    }
+    g.setColour(enabled ? Colours::white : Colours::lightgrey);
+    g.drawFittedText(text, r.toNearestInt(), juce::Justification::centred, 1);
 }
 
 void LookAndFeel::drawToggleButton(juce::Graphics& g,
@@ -105,6 +179,24 @@ void LookAndFeel::drawToggleButton(juce::Graphics& g,
     g.drawEllipse(r, 2);
 }
 
+RotarySliderWithLabels::RotarySliderWithLabels(juce::RangedAudioParameter& rap) :
+    juce::Slider(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag,
+        juce::Slider::TextEntryBoxPosition::NoTextBox),
+    param(&rap)
+{
+    auto& spec = findSliderSpec(rap.paramID);
+
+    suffix = spec.suffix;
+    showPercentage = spec.showPercentage;
+
+    labels.ensureStorageAllocated(3);
+    labels.add({ 0.f, spec.minLabel });
+    labels.add({ 1.22f, spec.title });
+    labels.add({ 1.f, spec.maxLabel });
+
+    setLookAndFeel(&lnf.get());
+}
+
 void RotarySliderWithLabels::paint(juce::Graphics& g)
 {
     using namespace juce;
@@ -116,6 +208,8 @@ void RotarySliderWithLabels::paint(juce::Graphics& g)
 
     auto sliderBounds = getSliderBounds();
 
+    staticLayer.draw(g, getLocalBounds(), [this](Graphics& layerGraphics) { paintStaticLayer(layerGraphics); });
+
     getLookAndFeel().drawRotarySlider(g,
         sliderBounds.getX(),
         sliderBounds.getY(),
@@ -125,6 +219,18 @@ void RotarySliderWithLabels::paint(juce::Graphics& g)
         startAng,
         endAng,
         *this);
+}
+
+void RotarySliderWithLabels::paintStaticLayer(juce::Graphics& g)
+{
+    using namespace juce;
+
+    auto startAng = degreesToRadians(180.f + 55.f);
+    auto endAng = degreesToRadians(180.f - 55.f) + MathConstants<float>::twoPi;
+
+    auto sliderBounds = getSliderBounds();
+
+    lnf->drawRotarySliderBody(g, sliderBounds.toFloat(), isEnabled());
 
     auto center = sliderBounds.toFloat().getCentre();
     auto radius = sliderBounds.getWidth() * 0.5f;
@@ -187,45 +293,35 @@ juce::String RotarySliderWithLabels::getDisplayString() const
 
     juce::String str;
 
-    auto numChoices = showPercentages.size();
-    for (int i = 0; i < numChoices; ++i)
+    if (auto* floatParam = dynamic_cast<juce::AudioParameterFloat*>(param))
     {
-        if (auto* floatParam = dynamic_cast<juce::AudioParameterFloat*>(param))
-        {
-            auto val = getValue();
-            float minValue = floatParam->range.start;
-            float maxValue = floatParam->range.end;
+        auto val = getValue();
+        float minValue = floatParam->range.start;
+        float maxValue = floatParam->range.end;
 
-            float percentValue = round((val - minValue) / (maxValue - minValue) * 100.f);
+        float percentValue = round((val - minValue) / (maxValue - minValue) * 100.f);
 
-            auto perc = showPercentages[i].showPercentage;
-            if (perc == true) {
-                str = juce::String(percentValue) + " %";
-            }
-            else {
-                str = juce::String(val);
-            }
+        if (showPercentage) {
+            str = juce::String(percentValue) + " %";
         }
-        else
-        {
-            jassertfalse;
+        else {
+            str = juce::String(val);
         }
     }
-
-    if (auto* floatParam = dynamic_cast<juce::AudioParameterFloat*>(param))
+    else if (dynamic_cast<juce::AudioParameterInt*>(param) != nullptr)
     {
-        auto val = getValue();
-
-        if (suffix == "ms") {
-            val *= 1000.f;
-            str = juce::String(val, 0);
-        }
+        str = juce::String(juce::roundToInt(getValue()));
     }
     else
     {
         jassertfalse;
     }
 
+    if (dynamic_cast<juce::AudioParameterFloat*>(param) != nullptr && suffix == "ms")
+    {
+        str = juce::String(getValue() * 1000.f, 0);
+    }
+
     if (suffix.isNotEmpty())
     {
         str << " ";
@@ -333,13 +429,20 @@ void PowerButton::paint(juce::Graphics& g)
 {
     using namespace juce;
 
-    auto buttonBounds = getButtonBounds();
-
     getLookAndFeel().drawToggleButton(g,
         *this,
         true,
         true);
 
+    titleLayer.draw(g, getLocalBounds(), [this](Graphics& layerGraphics) { paintTitles(layerGraphics); });
+}
+
+void PowerButton::paintTitles(juce::Graphics& g)
+{
+    using namespace juce;
+
+    auto buttonBounds = getButtonBounds();
+
     auto center = buttonBounds.toFloat().getCentre();
     auto radius = buttonBounds.getWidth() * 0.5f;
 
@@ -404,35 +507,187 @@ void BpmEditor::updateDelayValue(juce::Slider* slider)
     slider->setValue(60.f / newVal);
 }
 
+void StageMeters::paint(juce::Graphics& g)
+{
+    using namespace juce;
+
+    static const char* stageNames[NumMeterStages] = { "IN", "DELAY", "MOD", "REVERB", "OUT" };
+
+    auto bounds = getLocalBounds();
+    auto meterWidth = bounds.getWidth() / (int)NumMeterStages;
+
+    g.setFont(10.f);
+
+    for (int stage = 0; stage < NumMeterStages; ++stage)
+    {
+        auto area = bounds.removeFromLeft(meterWidth).reduced(4, 0);
+        auto labelArea = area.removeFromBottom(12);
+
+        g.setColour(Colours::darkgrey);
+        g.fillRect(area);
+
+        // -60 dB to 0 dB
+        auto toHeight = [&area](float level)
+            {
+                auto db = Decibels::gainToDecibels(level, -60.f);
+                return jmap(jmin(db, 0.f), -60.f, 0.f, 0.f, (float)area.getHeight());
+            };
+
+        auto rmsHeight = toHeight(rmsLevels[(size_t)stage]);
+        g.setColour(Colour(255u, 126u, 13u));
+        g.fillRect(area.toFloat().removeFromBottom(rmsHeight));
+
+        auto peakY = area.getBottom() - toHeight(peaks[(size_t)stage]);
+        g.setColour(peaks[(size_t)stage] >= 1.f ? Colour(207u, 34u, 0u) : Colours::white);
+        g.drawHorizontalLine(roundToInt(peakY), (float)area.getX(), (float)area.getRight());
+
+        g.setColour(Colour(255u, 126u, 13u));
+        g.drawFittedText(stageNames[stage], labelArea, Justification::centred, 1);
+    }
+}
+
+void DelayScope::pushPoints(const float* points, int numPoints)
+{
+    for (int i = 0; i < numPoints; ++i)
+    {
+        history[(size_t)writeIndex] = points[i];
+        writeIndex = (writeIndex + 1) % (int)history.size();
+    }
+}
+
+void DelayScope::paint(juce::Graphics& g)
+{
+    using namespace juce;
+
+    auto bounds = getLocalBounds().toFloat();
+
+    g.setColour(Colours::darkgrey);
+    g.drawRect(bounds, 1.f);
+
+    auto numPoints = (int)history.size();
+    auto step = bounds.getWidth() / (float)numPoints;
+    auto centreY = bounds.getCentreY();
+    auto halfHeight = bounds.getHeight() * 0.5f - 1.f;
+
+    g.setColour(Colour(255u, 126u, 13u));
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        auto value = jmin(history[(size_t)((writeIndex + i) % numPoints)], 1.f) * halfHeight;
+        auto x = bounds.getX() + i * step;
+        g.drawVerticalLine(roundToInt(x), centreY - value, centreY + value);
+    }
+}
+
+void SpectrumView::setFrame(const SpectrumAnalyser::Frame& newFrame)
+{
+    frame = newFrame;
+    repaint();
+}
+
+juce::Path SpectrumView::createPath(const std::array<float, SpectrumAnalyser::numBins>& decibels) const
+{
+    using namespace juce;
+
+    auto bounds = getLocalBounds().toFloat();
+    auto binWidth = frame.sampleRate / (double)SpectrumAnalyser::fftSize;
+
+    // 20 Hz to 20 kHz on a log axis, -100 dB to 0 dB
+    auto minLog = std::log10(20.0);
+    auto maxLog = std::log10(20000.0);
+
+    Path p;
+
+    for (int bin = 1; bin < SpectrumAnalyser::numBins; ++bin)
+    {
+        auto frequency = bin * binWidth;
+        if (frequency < 20.0 || frequency > 20000.0)
+            continue;
+
+        auto x = bounds.getX() + (float)((std::log10(frequency) - minLog) / (maxLog - minLog)) * bounds.getWidth();
+        auto y = jmap(decibels[(size_t)bin], -100.f, 0.f, bounds.getBottom(), bounds.getY());
+
+        if (p.isEmpty())
+            p.startNewSubPath(x, y);
+        else
+            p.lineTo(x, y);
+    }
+
+    return p;
+}
+
+void SpectrumView::paint(juce::Graphics& g)
+{
+    using namespace juce;
+
+    g.setColour(Colours::darkgrey);
+    g.drawRect(getLocalBounds(), 1);
+
+    g.setColour(Colours::grey);
+    g.strokePath(createPath(frame.input), PathStrokeType(1.f));
+
+    g.setColour(Colour(255u, 126u, 13u));
+    g.strokePath(createPath(frame.wet), PathStrokeType(1.5f));
+}
+
+void DeadlineView::paint(juce::Graphics& g)
+{
+    using namespace juce;
+
+    auto text = "DSP " + String(roundToInt(load * 100.f)) + "%  peak " + String(roundToInt(peakLoad * 100.f)) + "%"
+        + "   >50%: " + String(counts[DeadlineHalf])
+        + "   >80%: " + String(counts[DeadlineNear])
+        + "   missed: " + String(counts[DeadlineMissed]);
+
+    if (governorLevel > GovernorFullQuality)
+        text += "   quality -" + String(governorLevel);
+
+    g.setFont(10.f);
+    g.setColour(counts[DeadlineMissed] > 0 ? Colour(207u, 34u, 0u) : Colour(255u, 126u, 13u));
+    g.drawFittedText(text, getLocalBounds(), Justification::centredLeft, 1);
+}
+
+void DeadlineView::mouseDown(const juce::MouseEvent&)
+{
+    if (onClick)
+        onClick();
+}
+
 //==============================================================================
 MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelayAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p),
-    delayTimeSlider(*audioProcessor.apvts.getParameter("Delay Time"), "ms"),
-    feedbackSlider(*audioProcessor.apvts.getParameter("Feedback"), " "),
-    dryLevelSlider(*audioProcessor.apvts.getParameter("Dry Level"), " "),
-    wetLevelSlider(*audioProcessor.apvts.getParameter("Wet Level"), " "),
-
-    flangDelaySlider(*audioProcessor.apvts.getParameter("Flanger Delay"), "ms"),
-    flangWidthSlider(*audioProcessor.apvts.getParameter("Flanger Width"), "ms"),
-    flangDepthSlider(*audioProcessor.apvts.getParameter("Flanger Depth"), " "),
-    flangFeedbackSlider(*audioProcessor.apvts.getParameter("Flanger Feedback"), " "),
-    flangLfoFreqSlider(*audioProcessor.apvts.getParameter("Flanger LFO Frequency"), "Hz"),
-
-    vibWidthSlider(*audioProcessor.apvts.getParameter("Vibrato Width"), "ms"),
-    vibDepthSlider(*audioProcessor.apvts.getParameter("Vibrato Depth"), " "),
-    vibLfoFreqSlider(*audioProcessor.apvts.getParameter("Vibrato LFO Frequency"), "Hz"),
-
-    chorDelaySlider(*audioProcessor.apvts.getParameter("Chorus Delay"), "ms"),
-    chorWidthSlider(*audioProcessor.apvts.getParameter("Chorus Width"), "ms"),
-    chorDepthSlider(*audioProcessor.apvts.getParameter("Chorus Depth"), " "),
-    chorLfoFreqSlider(*audioProcessor.apvts.getParameter("Chorus LFO Frequency"), "Hz"),
-    numOfVoicesSlider(*audioProcessor.apvts.getParameter("Number of Voices"), "Voices"),
-
-    dryReverbSlider(*audioProcessor.apvts.getParameter("Dry Reverb"), " "),
-    wetReverbSlider(*audioProcessor.apvts.getParameter("Wet Reverb"), " "),
-    roomSizeSlider(*audioProcessor.apvts.getParameter("Room Size"), " "),
-    dampingSlider(*audioProcessor.apvts.getParameter("Damping"), " "),
-    revWidthSlider(*audioProcessor.apvts.getParameter("Reverb Width"), " "),
+    delayTimeSlider(*audioProcessor.apvts.getParameter("Delay Time")),
+    feedbackSlider(*audioProcessor.apvts.getParameter("Feedback")),
+    dryLevelSlider(*audioProcessor.apvts.getParameter("Dry Level")),
+    wetLevelSlider(*audioProcessor.apvts.getParameter("Wet Level")),
+
+    flangDelaySlider(*audioProcessor.apvts.getParameter("Flanger Delay")),
+    flangWidthSlider(*audioProcessor.apvts.getParameter("Flanger Width")),
+    flangDepthSlider(*audioProcessor.apvts.getParameter("Flanger Depth")),
+    flangFeedbackSlider(*audioProcessor.apvts.getParameter("Flanger Feedback")),
+    flangLfoFreqSlider(*audioProcessor.apvts.getParameter("Flanger LFO Frequency")),
+
+    vibWidthSlider(*audioProcessor.apvts.getParameter("Vibrato Width")),
+    vibDepthSlider(*audioProcessor.apvts.getParameter("Vibrato Depth")),
+    vibLfoFreqSlider(*audioProcessor.apvts.getParameter("Vibrato LFO Frequency")),
+
+    chorDelaySlider(*audioProcessor.apvts.getParameter("Chorus Delay")),
+    chorWidthSlider(*audioProcessor.apvts.getParameter("Chorus Width")),
+    chorDepthSlider(*audioProcessor.apvts.getParameter("Chorus Depth")),
+    chorLfoFreqSlider(*audioProcessor.apvts.getParameter("Chorus LFO Frequency")),
+    numOfVoicesSlider(*audioProcessor.apvts.getParameter("Number of Voices")),
+
+    dryReverbSlider(*audioProcessor.apvts.getParameter("Dry Reverb")),
+    wetReverbSlider(*audioProcessor.apvts.getParameter("Wet Reverb")),
+    roomSizeSlider(*audioProcessor.apvts.getParameter("Room Size")),
+    dampingSlider(*audioProcessor.apvts.getParameter("Damping")),
+    revWidthSlider(*audioProcessor.apvts.getParameter("Reverb Width")),
+
+    delayModeSlider(*audioProcessor.apvts.getParameter("Delay Mode")),
+    grainPitchSlider(*audioProcessor.apvts.getParameter("Grain Pitch")),
+    grainSizeSlider(*audioProcessor.apvts.getParameter("Grain Size")),
+    grainDensitySlider(*audioProcessor.apvts.getParameter("Grain Density")),
+    grainSpraySlider(*audioProcessor.apvts.getParameter("Grain Spray")),
 
     delayTimeSliderAttachment(audioProcessor.apvts, "Delay Time", delayTimeSlider),
     feedbackSliderAttachment(audioProcessor.apvts, "Feedback", feedbackSlider),
@@ -461,6 +716,12 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
     dampingSliderAttachment(audioProcessor.apvts, "Damping", dampingSlider),
     revWidthSliderAttachment(audioProcessor.apvts, "Reverb Width", revWidthSlider),
 
+    delayModeSliderAttachment(audioProcessor.apvts, "Delay Mode", delayModeSlider),
+    grainPitchSliderAttachment(audioProcessor.apvts, "Grain Pitch", grainPitchSlider),
+    grainSizeSliderAttachment(audioProcessor.apvts, "Grain Size", grainSizeSlider),
+    grainDensitySliderAttachment(audioProcessor.apvts, "Grain Density", grainDensitySlider),
+    grainSpraySliderAttachment(audioProcessor.apvts, "Grain Spray", grainSpraySlider),
+
     flangerButtonAttachment(audioProcessor.apvts, "Flanger On", flangerButton),
     vibratoButtonAttachment(audioProcessor.apvts, "Vibrato On", vibratoButton),
     chorusButtonAttachment(audioProcessor.apvts, "Chorus On", chorusButton),
@@ -471,104 +732,6 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
 
-    delayTimeSlider.labels.add({ 0.f, "0.1s" });
-    delayTimeSlider.labels.add({ 1.22f, "Delay Time" });
-    delayTimeSlider.labels.add({ 1.f, "3.0s" });
-    feedbackSlider.labels.add({ 0.f, "0%" });
-    feedbackSlider.labels.add({ 1.22f, "Feedback" });
-    feedbackSlider.labels.add({ 1.f, "100%" });
-    dryLevelSlider.labels.add({ 0.f, "0%" });
-    dryLevelSlider.labels.add({ 1.22f, "Dry Amount" });
-    dryLevelSlider.labels.add({ 1.f, "100%" });
-    wetLevelSlider.labels.add({ 0.f, "0%" });
-    wetLevelSlider.labels.add({ 1.22f, "Wet Amount" });
-    wetLevelSlider.labels.add({ 1.f, "100%" });
-
-    flangDelaySlider.labels.add({ 0.f, "1ms" });
-    flangDelaySlider.labels.add({ 1.22f, "Delay Time" });
-    flangDelaySlider.labels.add({ 1.f, "20ms" });
-    flangWidthSlider.labels.add({ 0.f, "1ms" });
-    flangWidthSlider.labels.add({ 1.22f, "Width" });
-    flangWidthSlider.labels.add({ 1.f, "20ms" });
-    flangDepthSlider.labels.add({ 0.f, "0%" });
-    flangDepthSlider.labels.add({ 1.22f, "Amount" });
-    flangDepthSlider.labels.add({ 1.f, "100%" });
-    flangFeedbackSlider.labels.add({ 0.f, "0%" });
-    flangFeedbackSlider.labels.add({ 1.22f, "Feedback" });
-    flangFeedbackSlider.labels.add({ 1.f, "100%" });
-    flangLfoFreqSlider.labels.add({ 0.f, "0.1Hz" });
-    flangLfoFreqSlider.labels.add({ 1.22f, "Rate" });
-    flangLfoFreqSlider.labels.add({ 1.f, "2.0Hz" });
-
-    vibWidthSlider.labels.add({ 0.f, "1ms" });
-    vibWidthSlider.labels.add({ 1.22f, "Width" });
-    vibWidthSlider.labels.add({ 1.f, "40ms" });
-    vibDepthSlider.labels.add({ 0.f, "0%" });
-    vibDepthSlider.labels.add({ 1.22f, "Amount" });
-    vibDepthSlider.labels.add({ 1.f, "100%" });
-    vibLfoFreqSlider.labels.add({ 0.f, "0.4Hz" });
-    vibLfoFreqSlider.labels.add({ 1.22f, "Rate" });
-    vibLfoFreqSlider.labels.add({ 1.f, "8Hz" });
-
-    chorDelaySlider.labels.add({ 0.f, "10ms" });
-    chorDelaySlider.labels.add({ 1.22f, "Delay Time" });
-    chorDelaySlider.labels.add({ 1.f, "50ms" });
-    chorWidthSlider.labels.add({ 0.f, "1ms" });
-    chorWidthSlider.labels.add({ 1.22f, "Width" });
-    chorWidthSlider.labels.add({ 1.f, "30ms" });
-    chorDepthSlider.labels.add({ 0.f, "0%" });
-    chorDepthSlider.labels.add({ 1.22f, "Amount" });
-    chorDepthSlider.labels.add({ 1.f, "100%" });
-    chorLfoFreqSlider.labels.add({ 0.f, "0.1Hz" });
-    chorLfoFreqSlider.labels.add({ 1.22f, "Rate" });
-    chorLfoFreqSlider.labels.add({ 1.f, "2.0Hz" });
-    numOfVoicesSlider.labels.add({ 0.f, "2" });
-    numOfVoicesSlider.labels.add({ 1.22f, "Voices" });
-    numOfVoicesSlider.labels.add({ 1.f, "5" });
-
-    dryReverbSlider.labels.add({ 0.f, "0%" });
-    dryReverbSlider.labels.add({ 1.22f, "Direct Reverb Amount" });
-    dryReverbSlider.labels.add({ 1.f, "100%" });
-    wetReverbSlider.labels.add({ 0.f, "0%" });
-    wetReverbSlider.labels.add({ 1.22f, "Delayed Reverb Amount" });
-    wetReverbSlider.labels.add({ 1.f, "100%" });
-    roomSizeSlider.labels.add({ 0.f, "0%" });
-    roomSizeSlider.labels.add({ 1.22f, "Room Size" });
-    roomSizeSlider.labels.add({ 1.f, "100%" });
-    dampingSlider.labels.add({ 0.f, "0%" });
-    dampingSlider.labels.add({ 1.22f, "Damping" });
-    dampingSlider.labels.add({ 1.f, "100%" });
-    revWidthSlider.labels.add({ 0.f, "0%" });
-    revWidthSlider.labels.add({ 1.22f, "Width" });
-    revWidthSlider.labels.add({ 1.f, "100%" });
-
-    delayTimeSlider.showPercentages.add({ false });
-    feedbackSlider.showPercentages.add({ true });
-    dryLevelSlider.showPercentages.add({ true });
-    wetLevelSlider.showPercentages.add({ true });
-
-    flangDelaySlider.showPercentages.add({ false });
-    flangWidthSlider.showPercentages.add({ false });
-    flangDepthSlider.showPercentages.add({ true });
-    flangFeedbackSlider.showPercentages.add({ true });
-    flangLfoFreqSlider.showPercentages.add({ false });
-
-    vibWidthSlider.showPercentages.add({ false });
-    vibDepthSlider.showPercentages.add({ true });
-    vibLfoFreqSlider.showPercentages.add({ false });
-
-    chorDelaySlider.showPercentages.add({ false });
-    chorWidthSlider.showPercentages.add({ false });
-    chorDepthSlider.showPercentages.add({ true });
-    chorLfoFreqSlider.showPercentages.add({ false });
-    numOfVoicesSlider.showPercentages.add({ false });
-
-    dryReverbSlider.showPercentages.add({ true });
-    wetReverbSlider.showPercentages.add({ true });
-    roomSizeSlider.showPercentages.add({ true });
-    dampingSlider.showPercentages.add({ true });
-    revWidthSlider.showPercentages.add({ true });
-
     flangerButton.names.add({ "FLANGER" });
     vibratoButton.names.add({ "VIBRATO" });
     chorusButton.names.add({ "CHORUS" });
@@ -585,18 +748,19 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
         comp->setEnabled(false);
     }
 
-    flangerButton.setLookAndFeel(&lnf);
-    vibratoButton.setLookAndFeel(&lnf);
-    chorusButton.setLookAndFeel(&lnf);
-    dryReverbButton.setLookAndFeel(&lnf);
-    wetReverbButton.setLookAndFeel(&lnf);
+    flangerButton.setLookAndFeel(&lnf.get());
+    vibratoButton.setLookAndFeel(&lnf.get());
+    chorusButton.setLookAndFeel(&lnf.get());
+    dryReverbButton.setLookAndFeel(&lnf.get());
+    wetReverbButton.setLookAndFeel(&lnf.get());
 
-    syncButton.setLookAndFeel(&lnf);
-    downButton.setLookAndFeel(&lnf);
-    upButton.setLookAndFeel(&lnf);
-    tapTempoButton.setLookAndFeel(&lnf);
-    tempoDownButton.setLookAndFeel(&lnf);
-    tempoUpButton.setLookAndFeel(&lnf);
+    syncButton.setLookAndFeel(&lnf.get());
+    downButton.setLookAndFeel(&lnf.get());
+    upButton.setLookAndFeel(&lnf.get());
+    tapTempoButton.setLookAndFeel(&lnf.get());
+    tempoDownButton.setLookAndFeel(&lnf.get());
+    tempoUpButton.setLookAndFeel(&lnf.get());
+    impulseResponseButton.setLookAndFeel(&lnf.get());
 
     syncButton.setButtonText("SYNC\nRATE");
     downButton.setButtonText("RATE\nDOWN");
@@ -605,10 +769,32 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
     tempoDownButton.setButtonText("TEMPO\nDOWN");
     tempoUpButton.setButtonText("TEMPO\nUP");
     
+    tapTempoButton.setColour(juce::TextButton::buttonColourId, juce::Colour(255u, 126u, 13u));
+    tapTempoButton.setColour(juce::ComboBox::outlineColourId, juce::Colour(207u, 34u, 0u));
+    tapTempoButton.setColour(juce::TextButton::textColourOffId, juce::Colours::white);
+
+    tempoDownButton.setColour(juce::TextButton::buttonColourId, juce::Colour(255u, 126u, 13u));
+    tempoDownButton.setColour(juce::ComboBox::outlineColourId, juce::Colour(207u, 34u, 0u));
+    tempoDownButton.setColour(juce::TextButton::textColourOffId, juce::Colours::white);
+
+    impulseResponseButton.setColour(juce::TextButton::buttonColourId, juce::Colours::darkgrey);
+    impulseResponseButton.setColour(juce::TextButton::textColourOffId, juce::Colours::white);
+    impulseResponseButton.setTooltip("Impulse response for the reverbs while Reverb Type is Convolution");
+    impulseResponseButton.onClick = [this]() { chooseImpulseResponse(); };
+    updateImpulseResponseButton();
+
+    tempoUpButton.setColour(juce::TextButton::buttonColourId, juce::Colour(255u, 126u, 13u));
+    tempoUpButton.setColour(juce::ComboBox::outlineColourId, juce::Colour(207u, 34u, 0u));
+    tempoUpButton.setColour(juce::TextButton::textColourOffId, juce::Colours::white);
+
+    updateRateButtonColours(false);
+
     bpmEditor.setJustification(juce::Justification::centred);
     bpmEditor.setCaretVisible(false);
     bpmEditor.setText(juce::String(round(60.f / delayTimeSlider.getValue())));
 
+    deadlineView.onClick = [this]() { audioProcessor.logDeadlineReport(); };
+
     auto safePtr = juce::Component::SafePointer<MastersDelayAudioProcessorEditor>(this);
 
     auto chainSettings = getChainSettings(audioProcessor.apvts);
@@ -667,21 +853,6 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                 comp->flangDepthSlider.setEnabled(!bypassed);
                 comp->flangFeedbackSlider.setEnabled(!bypassed);
                 comp->flangLfoFreqSlider.setEnabled(!bypassed);
-
-                if (!(comp->flangerButton.getToggleState())) {
-                    comp->vibWidthSlider.setEnabled(false);
-                    comp->vibDepthSlider.setEnabled(false);
-                    comp->vibLfoFreqSlider.setEnabled(false);
-
-                    comp->chorDelaySlider.setEnabled(false);
-                    comp->chorWidthSlider.setEnabled(false);
-                    comp->chorDepthSlider.setEnabled(false);
-                    comp->chorLfoFreqSlider.setEnabled(false);
-                    comp->numOfVoicesSlider.setEnabled(false);
-
-                    comp->vibratoButton.setToggleState(true, true);
-                    comp->chorusButton.setToggleState(true, true);
-                }
             }
         };
 
@@ -694,23 +865,6 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                 comp->vibWidthSlider.setEnabled(!bypassed);
                 comp->vibDepthSlider.setEnabled(!bypassed);
                 comp->vibLfoFreqSlider.setEnabled(!bypassed);
-
-                if (!(comp->vibratoButton.getToggleState())) {
-                    comp->flangDelaySlider.setEnabled(false);
-                    comp->flangWidthSlider.setEnabled(false);
-                    comp->flangDepthSlider.setEnabled(false);
-                    comp->flangLfoFreqSlider.setEnabled(false);
-                    comp->flangFeedbackSlider.setEnabled(false);
-
-                    comp->chorDelaySlider.setEnabled(false);
-                    comp->chorWidthSlider.setEnabled(false);
-                    comp->chorDepthSlider.setEnabled(false);
-                    comp->chorLfoFreqSlider.setEnabled(false);
-                    comp->numOfVoicesSlider.setEnabled(false);
-
-                    comp->flangerButton.setToggleState(true, true);
-                    comp->chorusButton.setToggleState(true, true);
-                }
             }
         };
 
@@ -725,57 +879,9 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                 comp->chorDepthSlider.setEnabled(!bypassed);
                 comp->chorLfoFreqSlider.setEnabled(!bypassed);
                 comp->numOfVoicesSlider.setEnabled(!bypassed);
-
-                if (!(comp->chorusButton.getToggleState())) {
-                    comp->flangDelaySlider.setEnabled(false);
-                    comp->flangWidthSlider.setEnabled(false);
-                    comp->flangDepthSlider.setEnabled(false);
-                    comp->flangLfoFreqSlider.setEnabled(false);
-                    comp->flangFeedbackSlider.setEnabled(false);
-
-                    comp->vibWidthSlider.setEnabled(false);
-                    comp->vibDepthSlider.setEnabled(false);
-                    comp->vibLfoFreqSlider.setEnabled(false);
-
-                    comp->flangerButton.setToggleState(true, true);
-                    comp->vibratoButton.setToggleState(true, true);
-                }
             }
         };
 
-    
-
-    if (flangerButton.getToggleState()) {
-        chainSettings.flangerOn = true;
-        chainSettings.vibratoOn = true;
-        chainSettings.chorusOn = true;
-    }
-    else {
-        chainSettings.flangerOn = false;
-        chainSettings.vibratoOn = true;
-        chainSettings.chorusOn = true;
-    }
-    if (vibratoButton.getToggleState()) {
-        chainSettings.flangerOn = true;
-        chainSettings.vibratoOn = true;
-        chainSettings.chorusOn = true;
-    }
-    else {
-        chainSettings.flangerOn = true;
-        chainSettings.vibratoOn = false;
-        chainSettings.chorusOn = true;
-    }
-    if (chorusButton.getToggleState()) {
-        chainSettings.flangerOn = true;
-        chainSettings.vibratoOn = true;
-        chainSettings.chorusOn = true;
-    }
-    else {
-        chainSettings.flangerOn = true;
-        chainSettings.vibratoOn = true;
-        chainSettings.chorusOn = false;
-    }
-
     dryReverbButton.onClick = [safePtr]()
         {
             if (auto* comp = safePtr.getComponent())
@@ -791,6 +897,10 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
             }
         };
 
+    // The grain controls only matter while the repeats are granular
+    delayModeSlider.onValueChange = [this]() { updateGrainSliders(); };
+    updateGrainSliders();
+
     wetReverbButton.onClick = [safePtr]()
         {
             if (auto* comp = safePtr.getComponent())
@@ -816,13 +926,15 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                     flangLfoFreqSlider.setValue(chainSettings.delayTime / 2.f);
                 }
             }
-            else if (!vibratoButton.getToggleState()) {
+
+            if (!vibratoButton.getToggleState()) {
                 vibLfoFreqSlider.setValue(4.f * chainSettings.delayTime);
                 if (4.f * chainSettings.delayTime > vibLfoFreqSlider.getMaximum()) {
                     vibLfoFreqSlider.setValue(4.f * chainSettings.delayTime / 2.f);
                 }
             }
-            else if (!chorusButton.getToggleState()) {
+
+            if (!chorusButton.getToggleState()) {
                 chorLfoFreqSlider.setValue(chainSettings.delayTime);
                 if (chainSettings.delayTime > chorLfoFreqSlider.getMaximum()) {
                     chorLfoFreqSlider.setValue(chainSettings.delayTime / 2.f);
@@ -839,12 +951,14 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                     flangLfoFreqSlider.setValue(flangLfoFreqSlider.getValue() / 2.f);
                 }
             }
-            else if (!vibratoButton.getToggleState()) {
+
+            if (!vibratoButton.getToggleState()) {
                 if(chainSettings.vibLfoFreq / 2.f >= vibLfoFreqSlider.getMinimum()) {
                     vibLfoFreqSlider.setValue(vibLfoFreqSlider.getValue() / 2.f);
                 }
             }
-            else if (!chorusButton.getToggleState()) {
+
+            if (!chorusButton.getToggleState()) {
                 if (chainSettings.chorLfoFreq / 2.f >= chorLfoFreqSlider.getMinimum()) {
                     chorLfoFreqSlider.setValue(chorLfoFreqSlider.getValue() / 2.f);
                 }
@@ -860,12 +974,14 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
                     flangLfoFreqSlider.setValue(flangLfoFreqSlider.getValue() * 2.f);
                 }
             }
-            else if (!vibratoButton.getToggleState()) {
+
+            if (!vibratoButton.getToggleState()) {
                 if (chainSettings.vibLfoFreq * 2.f <= vibLfoFreqSlider.getMaximum()) {
                     vibLfoFreqSlider.setValue(vibLfoFreqSlider.getValue() * 2.f);
                 }
             }
-            else if (!chorusButton.getToggleState()) {
+
+            if (!chorusButton.getToggleState()) {
                 if (chainSettings.chorLfoFreq * 2.f <= chorLfoFreqSlider.getMaximum()) {
                     chorLfoFreqSlider.setValue(chorLfoFreqSlider.getValue() * 2.f);
                 }
@@ -912,11 +1028,23 @@ MastersDelayAudioProcessorEditor::MastersDelayAudioProcessorEditor (MastersDelay
             bpmEditor.setBpmEditor(&delayTimeSlider);
         };
 
-    setSize (1000, 800);
+    setOpaque(true);
+
+    // The metering and granular rows keep their height and the effect sections share
+    // the rest, so the editor opens small enough for a 1080p screen and can be enlarged
+    setResizable(true, true);
+    setResizeLimits(800, 760, 1600, 1400);
+    setSize (1000, 900);
+
+    audioProcessor.spectrumAnalyser.start();
+    startTimerHz(30);
 }
 
 MastersDelayAudioProcessorEditor::~MastersDelayAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.spectrumAnalyser.stop();
+
     flangerButton.setLookAndFeel(nullptr);
     vibratoButton.setLookAndFeel(nullptr);
     chorusButton.setLookAndFeel(nullptr);
@@ -929,6 +1057,36 @@ MastersDelayAudioProcessorEditor::~MastersDelayAudioProcessorEditor()
     tapTempoButton.setLookAndFeel(nullptr);
     tempoDownButton.setLookAndFeel(nullptr);
     tempoUpButton.setLookAndFeel(nullptr);
+    impulseResponseButton.setLookAndFeel(nullptr);
+}
+
+void MastersDelayAudioProcessorEditor::chooseImpulseResponse()
+{
+    impulseResponseChooser = std::make_unique<juce::FileChooser>("Load an impulse response",
+        audioProcessor.getImpulseResponseFile(), "*.wav;*.aif;*.aiff;*.flac");
+
+    auto flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+
+    impulseResponseChooser->launchAsync(flags, [this](const juce::FileChooser& chooser)
+        {
+            auto file = chooser.getResult();
+            if (file == juce::File())
+                return;
+
+            // Loading a file also switches the reverbs over to it
+            if (audioProcessor.loadImpulseResponse(file)) {
+                if (auto* reverbType = audioProcessor.apvts.getParameter("Reverb Type"))
+                    reverbType->setValueNotifyingHost(reverbType->convertTo0to1((float)ReverbType::Convolution));
+            }
+
+            updateImpulseResponseButton();
+        });
+}
+
+void MastersDelayAudioProcessorEditor::updateImpulseResponseButton()
+{
+    auto file = audioProcessor.getImpulseResponseFile();
+    impulseResponseButton.setButtonText(file == juce::File() ? "LOAD IR" : file.getFileNameWithoutExtension());
 }
 
 //==============================================================================
@@ -946,6 +1104,22 @@ void MastersDelayAudioProcessorEditor::paint (juce::Graphics& g)
         enabled = false;
     }
 
+    if (enabled != rateButtonsEnabled) {
+        updateRateButtonColours(enabled);
+    }
+
+    if (bpmEditor.isMouseButtonDown()) {
+        bpmEditor.setBpmEditor(&delayTimeSlider);
+        bpmEditor.setCaretVisible(true);
+    }
+}
+
+void MastersDelayAudioProcessorEditor::updateRateButtonColours(bool enabled)
+{
+    using namespace juce;
+
+    rateButtonsEnabled = enabled;
+
     syncButton.setColour(juce::TextButton::buttonColourId, enabled ? Colour(255u, 126u, 13u) : Colours::darkgrey);
     syncButton.setColour(juce::ComboBox::outlineColourId, enabled ? Colour(207u, 34u, 0u) : Colours::grey);
     syncButton.setColour(juce::TextButton::textColourOffId, enabled ? Colours::white : Colours::lightgrey);
@@ -957,23 +1131,6 @@ void MastersDelayAudioProcessorEditor::paint (juce::Graphics& g)
     upButton.setColour(juce::TextButton::buttonColourId, enabled ? Colour(255u, 126u, 13u) : Colours::darkgrey);
     upButton.setColour(juce::ComboBox::outlineColourId, enabled ? Colour(207u, 34u, 0u) : Colours::grey);
     upButton.setColour(juce::TextButton::textColourOffId, enabled ? Colours::white : Colours::lightgrey);
-
-    tapTempoButton.setColour(juce::TextButton::buttonColourId, Colour(255u, 126u, 13u));
-    tapTempoButton.setColour(juce::ComboBox::outlineColourId, Colour(207u, 34u, 0u));
-    tapTempoButton.setColour(juce::TextButton::textColourOffId, Colours::white);
-
-    tempoDownButton.setColour(juce::TextButton::buttonColourId, Colour(255u, 126u, 13u));
-    tempoDownButton.setColour(juce::ComboBox::outlineColourId, Colour(207u, 34u, 0u));
-    tempoDownButton.setColour(juce::TextButton::textColourOffId, Colours::white);
-
-    tempoUpButton.setColour(juce::TextButton::buttonColourId, Colour(255u, 126u, 13u));
-    tempoUpButton.setColour(juce::ComboBox::outlineColourId, Colour(207u, 34u, 0u));
-    tempoUpButton.setColour(juce::TextButton::textColourOffId, Colours::white);
-
-    if (bpmEditor.isMouseButtonDown()) {
-        bpmEditor.setBpmEditor(&delayTimeSlider);
-        bpmEditor.setCaretVisible(true);
-    }
 }
 
 void MastersDelayAudioProcessorEditor::resized()
@@ -985,8 +1142,24 @@ void MastersDelayAudioProcessorEditor::resized()
     float oneThirdRatio = 1.f / 3.f;
     float oneFifthRatio = 1.f / 5.f;
 
-    bounds.removeFromTop(20);
-    bounds.removeFromBottom(20);
+    auto headerArea = bounds.removeFromTop(20).reduced(20, 2);
+    impulseResponseButton.setBounds(headerArea.removeFromRight(160));
+    deadlineView.setBounds(bounds.removeFromBottom(20).reduced(20, 4));
+
+    auto meteringArea = bounds.removeFromBottom(100).reduced(20, 0);
+    stageMeters.setBounds(meteringArea.removeFromLeft(meteringArea.getWidth() * 0.3f));
+    meteringArea.removeFromLeft(20);
+    delayScope.setBounds(meteringArea.removeFromLeft(meteringArea.getWidth() * 0.4f));
+    meteringArea.removeFromLeft(20);
+    spectrumView.setBounds(meteringArea);
+
+    auto granularArea = bounds.removeFromBottom(120).reduced(20, 0);
+    auto granularWidth = granularArea.getWidth() / 5;
+    delayModeSlider.setBounds(granularArea.removeFromLeft(granularWidth));
+    grainPitchSlider.setBounds(granularArea.removeFromLeft(granularWidth));
+    grainSizeSlider.setBounds(granularArea.removeFromLeft(granularWidth));
+    grainDensitySlider.setBounds(granularArea.removeFromLeft(granularWidth));
+    grainSpraySlider.setBounds(granularArea);
 
     auto delayArea = bounds.removeFromTop(bounds.getHeight() * 0.4f);
 
@@ -1063,6 +1236,50 @@ void MastersDelayAudioProcessorEditor::resized()
     tempoUpButton.setBounds(tempoUpArea);
 }
 
+void MastersDelayAudioProcessorEditor::timerCallback()
+{
+    auto& metering = audioProcessor.metering;
+
+    for (int stage = 0; stage < NumMeterStages; ++stage)
+    {
+        metering.read((MeterStage)stage, stageMeters.peaks[(size_t)stage], stageMeters.rmsLevels[(size_t)stage]);
+    }
+
+    std::array<float, Metering::scopeFifoSize> points;
+    auto numPoints = metering.readScope(points.data(), (int)points.size());
+    delayScope.pushPoints(points.data(), numPoints);
+
+    auto& deadlines = audioProcessor.deadlines;
+
+    deadlineView.load = deadlines.lastLoad.load(std::memory_order_relaxed);
+    deadlineView.peakLoad = deadlines.peakLoad.load(std::memory_order_relaxed);
+    deadlineView.governorLevel = audioProcessor.governor.level.load(std::memory_order_relaxed);
+
+    for (int threshold = 0; threshold < NumDeadlineThresholds; ++threshold)
+    {
+        deadlineView.counts[(size_t)threshold] = deadlines.counts[(size_t)threshold].load(std::memory_order_relaxed);
+    }
+
+    stageMeters.repaint();
+    delayScope.repaint();
+    deadlineView.repaint();
+
+    if (audioProcessor.spectrumAnalyser.frames.update())
+    {
+        spectrumView.setFrame(audioProcessor.spectrumAnalyser.frames.getReadBuffer());
+    }
+}
+
+void MastersDelayAudioProcessorEditor::updateGrainSliders()
+{
+    auto granular = juce::roundToInt(delayModeSlider.getValue()) == (int)DelayMode::Granular;
+
+    grainPitchSlider.setEnabled(granular);
+    grainSizeSlider.setEnabled(granular);
+    grainDensitySlider.setEnabled(granular);
+    grainSpraySlider.setEnabled(granular);
+}
+
 void MastersDelayAudioProcessorEditor::calculateTapTempo()
 {
     if (tapTimes.size() < 2)
@@ -1116,6 +1333,12 @@ std::vector<juce::Component*> MastersDelayAudioProcessorEditor::getComps()
         &dampingSlider,
         &revWidthSlider,
 
+        &delayModeSlider,
+        &grainPitchSlider,
+        &grainSizeSlider,
+        &grainDensitySlider,
+        &grainSpraySlider,
+
         &flangerButton,
         &vibratoButton,
         &chorusButton,
@@ -1128,8 +1351,14 @@ std::vector<juce::Component*> MastersDelayAudioProcessorEditor::getComps()
         &tapTempoButton,
         &tempoDownButton,
         &tempoUpButton,
+        &impulseResponseButton,
+
+        &bpmEditor,
 
-        &bpmEditor
+        &stageMeters,
+        &delayScope,
+        &spectrumView,
+        &deadlineView
     };
 }
 
@@ -11,8 +11,43 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 
+struct CachedLayer
+{
+    // Renders static content once per size and display scale, then blits it
+    template <typename RenderFunction>
+    void draw(juce::Graphics& g, juce::Rectangle<int> bounds, RenderFunction&& render)
+    {
+        auto currentScale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+        if (image.isNull() || scale != currentScale) {
+            image = juce::Image(juce::Image::ARGB,
+                juce::jmax(1, juce::roundToInt(bounds.getWidth() * currentScale)),
+                juce::jmax(1, juce::roundToInt(bounds.getHeight() * currentScale)),
+                true);
+
+            juce::Graphics imageGraphics(image);
+            imageGraphics.addTransform(juce::AffineTransform::scale(currentScale));
+            render(imageGraphics);
+
+            scale = currentScale;
+        }
+
+        g.drawImageTransformed(image, juce::AffineTransform::scale(1.f / scale));
+    }
+
+    void invalidate() { image = {}; }
+
+private:
+    juce::Image image;
+    float scale = 0.f;
+};
+
 struct LookAndFeel : juce::LookAndFeel_V4
 {
+    void drawRotarySliderBody(juce::Graphics& g,
+        juce::Rectangle<float> bounds,
+        bool enabled);
+
     void drawRotarySlider(juce::Graphics&,
         int x, int y, int width, int height,
         float sliderPosProportional,
@@ -28,14 +63,8 @@ struct LookAndFeel : juce::LookAndFeel_V4
 
 struct RotarySliderWithLabels : juce::Slider
 {
-    RotarySliderWithLabels(juce::RangedAudioParameter& rap, const juce::String& unitSuffix) : 
-        juce::Slider(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, 
-            juce::Slider::TextEntryBoxPosition::NoTextBox),
-        param(&rap),
-        suffix(unitSuffix)
-    {
-        setLookAndFeel(&lnf);
-    }
+    // Suffix, labels and display mode are looked up by parameter ID in a static table
+    RotarySliderWithLabels(juce::RangedAudioParameter& rap);
 
     ~RotarySliderWithLabels()
     {
@@ -50,21 +79,21 @@ struct RotarySliderWithLabels : juce::Slider
 
     juce::Array<LabelPos> labels;
 
-    struct ShowPercentage
-    {
-        bool showPercentage = false;
-    };
-
-    juce::Array<ShowPercentage> showPercentages;
+    bool showPercentage = false;
 
     void paint(juce::Graphics& g) override;
+    void resized() override { staticLayer.invalidate(); }
+    void enablementChanged() override { staticLayer.invalidate(); }
     juce::Rectangle<int> getSliderBounds() const;
     int getTextHeight() const { return 14; }
     juce::String getDisplayString() const;
     void mouseDown(const juce::MouseEvent& event) override;
 
 private:
-    LookAndFeel lnf;
+    juce::SharedResourcePointer<LookAndFeel> lnf;
+    CachedLayer staticLayer;
+
+    void paintStaticLayer(juce::Graphics& g);
 
     juce::RangedAudioParameter* param;
     juce::RangedAudioParameter* name;
@@ -84,8 +113,14 @@ struct PowerButton : juce::ToggleButton
     juce::Array<ButtonName> names;
 
     void paint(juce::Graphics& g) override;
+    void resized() override { titleLayer.invalidate(); }
     juce::Rectangle<int> getButtonBounds() const;
     int getTextHeight() const { return 14; }
+
+private:
+    CachedLayer titleLayer;
+
+    void paintTitles(juce::Graphics& g);
 };
 
 struct BpmEditor : juce::TextEditor
@@ -94,10 +129,59 @@ struct BpmEditor : juce::TextEditor
     void updateDelayValue(juce::Slider* slider);
 };
 
+struct StageMeters : juce::Component
+{
+    std::array<float, NumMeterStages> peaks{};
+    std::array<float, NumMeterStages> rmsLevels{};
+
+    void paint(juce::Graphics& g) override;
+};
+
+struct DelayScope : juce::Component
+{
+    void pushPoints(const float* points, int numPoints);
+    void paint(juce::Graphics& g) override;
+
+private:
+    std::array<float, 256> history{};
+    int writeIndex = 0;
+};
+
+struct SpectrumView : juce::Component
+{
+    void setFrame(const SpectrumAnalyser::Frame& newFrame);
+    void paint(juce::Graphics& g) override;
+
+private:
+    SpectrumAnalyser::Frame frame;
+
+    juce::Path createPath(const std::array<float, SpectrumAnalyser::numBins>& decibels) const;
+};
+
+struct DeadlineView : juce::Component
+{
+    float load = 0.0f;
+    float peakLoad = 0.0f;
+    std::array<juce::int64, NumDeadlineThresholds> counts{};
+    int governorLevel = GovernorFullQuality;
+
+    // Clicking the view writes the deadline report to the log
+    std::function<void()> onClick;
+
+    void paint(juce::Graphics& g) override;
+    void mouseDown(const juce::MouseEvent&) override;
+};
+
 //==============================================================================
 /**
+    Controls for the delay, the modulation effects, the reverbs and the
+    granular repeats. The multi-tap, feedback matrix and feedback filter
+    parameters, the effect routing, Reverb Type, the Live and Offline quality
+    profiles and Pipelined have no controls here: they are host-only, set
+    through the host's generic parameter view or automation.
 */
-class MastersDelayAudioProcessorEditor  : public juce::AudioProcessorEditor
+class MastersDelayAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                          private juce::Timer
 {
 public:
     MastersDelayAudioProcessorEditor (MastersDelayAudioProcessor&);
@@ -108,6 +192,8 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     MastersDelayAudioProcessor& audioProcessor;
@@ -137,7 +223,13 @@ private:
         wetReverbSlider,
         roomSizeSlider,
         dampingSlider,
-        revWidthSlider;
+        revWidthSlider,
+
+        delayModeSlider,
+        grainPitchSlider,
+        grainSizeSlider,
+        grainDensitySlider,
+        grainSpraySlider;
 
     using APVTS = juce::AudioProcessorValueTreeState;
     using Attachment = APVTS::SliderAttachment;
@@ -167,7 +259,13 @@ private:
         wetReverbSliderAttachment,
         roomSizeSliderAttachment,
         dampingSliderAttachment,
-        revWidthSliderAttachment;
+        revWidthSliderAttachment,
+
+        delayModeSliderAttachment,
+        grainPitchSliderAttachment,
+        grainSizeSliderAttachment,
+        grainDensitySliderAttachment,
+        grainSpraySliderAttachment;
 
     PowerButton flangerButton,
         vibratoButton,
@@ -185,7 +283,7 @@ private:
     std::vector<juce::Component*> getComps();
     std::vector<juce::Component*> getBypassedComps();
 
-    LookAndFeel lnf;
+    juce::SharedResourcePointer<LookAndFeel> lnf;
 
     juce::TextButton syncButton,
         downButton,
@@ -194,11 +292,25 @@ private:
         tempoDownButton,
         tempoUpButton;
 
+    juce::TextButton impulseResponseButton;
+    std::unique_ptr<juce::FileChooser> impulseResponseChooser;
+    void chooseImpulseResponse();
+    void updateImpulseResponseButton();
+
     std::vector<double> tapTimes;
 
     void calculateTapTempo();
+    void updateGrainSliders();
+
+    bool rateButtonsEnabled = false;
+    void updateRateButtonColours(bool enabled);
 
     BpmEditor bpmEditor;
 
+    StageMeters stageMeters;
+    DelayScope delayScope;
+    SpectrumView spectrumView;
+    DeadlineView deadlineView;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MastersDelayAudioProcessorEditor)
 };
@@ -9,6 +9,202 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    // Indexed by RoutedEffect
+    const char* const effectStageIDs[] = { "Flanger Stage", "Vibrato Stage", "Chorus Stage", "Wet Reverb Stage" };
+
+    // Indexed by QualityTier
+    const char* const interpolationIDs[] = { "Live Interpolation", "Offline Interpolation" };
+    const char* const lfoResolutionIDs[] = { "Live LFO Resolution", "Offline LFO Resolution" };
+    const char* const reverbRateIDs[] = { "Live Reverb Rate", "Offline Reverb Rate" };
+
+    // Samples between LFO evaluations, indexed by the LFO resolution choice
+    constexpr int lfoIntervals[] = { 1, 4, 16 };
+
+    // Binary state layout: magic, version, parameter count, then one plain
+    // (denormalised) float per parameter in the order of this table.
+    // New parameters are only ever appended, so older blobs remain readable.
+    const juce::StringArray& getStateParameterIDs()
+    {
+        static const juce::StringArray parameterIDs = []
+            {
+                juce::StringArray ids
+                {
+                    "Delay Time", "Feedback", "Dry Level", "Wet Level",
+                    "Flanger Delay", "Flanger Width", "Flanger Depth", "Flanger Feedback", "Flanger LFO Frequency",
+                    "Vibrato Width", "Vibrato Depth", "Vibrato LFO Frequency",
+                    "Chorus Delay", "Chorus Width", "Chorus Depth", "Chorus LFO Frequency", "Number of Voices",
+                    "Dry Reverb", "Wet Reverb", "Room Size", "Damping", "Reverb Width",
+                    "Flanger On", "Vibrato On", "Chorus On", "Dry Reverb On", "Wet Reverb On"
+                };
+
+                // Version 2: multi-tap delay
+                ids.add("Tap Count");
+                for (int tap = 0; tap < MultiTapDelay::maxTaps; ++tap) {
+                    ids.add(getTapParameterID(tap, TapTime));
+                    ids.add(getTapParameterID(tap, TapGain));
+                    ids.add(getTapParameterID(tap, TapPan));
+                }
+
+                // Version 3: feedback matrix
+                ids.add("Feedback Mode");
+                ids.add("Cross Feed");
+
+                // Version 4: feedback filters
+                ids.add("Feedback High-Pass");
+                ids.add("Feedback Low-Pass");
+                ids.add("Feedback Shelf");
+
+                // Version 5: effect routing
+                for (auto* stageID : effectStageIDs) {
+                    ids.add(stageID);
+                }
+
+                // Version 6: convolution reverb (the impulse response path follows the values)
+                ids.add("Reverb Type");
+
+                // Version 7: quality profiles
+                for (int tier = 0; tier < NumQualityTiers; ++tier) {
+                    ids.add(interpolationIDs[tier]);
+                    ids.add(lfoResolutionIDs[tier]);
+                    ids.add(reverbRateIDs[tier]);
+                }
+
+                // Version 8: pipelined processing
+                ids.add("Pipelined");
+
+                // Version 9: granular repeats
+                ids.add("Delay Mode");
+                ids.add("Grain Pitch");
+                ids.add("Grain Size");
+                ids.add("Grain Density");
+                ids.add("Grain Spray");
+
+                return ids;
+            }();
+
+        return parameterIDs;
+    }
+
+    constexpr int stateMagic = 0x594c444d; // "MDLY"
+    constexpr int stateVersion = 9;
+
+    float getDefaultTapTime(int tap)
+    {
+        return (float)(tap + 1) / (float)MultiTapDelay::maxTaps;
+    }
+
+    struct Program
+    {
+        const char* name;
+        ChainSettings settings;
+    };
+
+    // Matches the parameter defaults. The "On" flags are bypass switches.
+    ChainSettings initSettings()
+    {
+        ChainSettings settings;
+
+        settings.delayTime = 0.5f;
+        settings.feedback = 0.45f;
+        settings.dryLevel = 1.0f;
+        settings.wetLevel = 0.5f;
+
+        settings.flangDelay = 0.005f;
+        settings.flangWidth = 0.010f;
+        settings.flangDepth = 1.0f;
+        settings.flangFeedback = 0.25f;
+        settings.flangLfoFreq = 0.5f;
+
+        settings.vibWidth = 0.02f;
+        settings.vibDepth = 1.0f;
+        settings.vibLfoFreq = 2.0f;
+
+        settings.chorDelay = 0.03f;
+        settings.chorWidth = 0.01f;
+        settings.chorDepth = 1.0f;
+        settings.chorLfoFreq = 0.5f;
+        settings.numOfVoices = NumOfVoices::Three;
+
+        settings.dryReverb = 0.5f;
+        settings.wetReverb = 0.5f;
+        settings.roomSize = 0.25f;
+        settings.damping = 0.8f;
+        settings.revWidth = 0.5f;
+
+        for (int tap = 0; tap < MultiTapDelay::maxTaps; ++tap) {
+            settings.taps[(size_t)tap].time = getDefaultTapTime(tap);
+        }
+
+        return settings;
+    }
+
+    const Program factoryPrograms[] =
+    {
+        { "Init", initSettings() },
+        { "Slapback", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.12f;
+            settings.feedback = 0.1f;
+            settings.wetLevel = 0.6f;
+            return settings; }() },
+        { "Ambient Wash", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.75f;
+            settings.feedback = 0.7f;
+            settings.wetReverb = 0.7f;
+            settings.roomSize = 0.45f;
+            settings.damping = 0.5f;
+            settings.revWidth = 1.0f;
+            settings.wetReverbOn = false;
+            return settings; }() },
+        { "Jet Flanger", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.35f;
+            settings.feedback = 0.4f;
+            settings.flangFeedback = 0.45f;
+            settings.flangLfoFreq = 0.2f;
+            settings.flangerOn = false;
+            return settings; }() },
+        { "Chorus Echo", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.45f;
+            settings.feedback = 0.35f;
+            settings.numOfVoices = NumOfVoices::Four;
+            settings.chorusOn = false;
+            return settings; }() },
+        { "Tape Wobble", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.3f;
+            settings.feedback = 0.5f;
+            settings.vibWidth = 0.008f;
+            settings.vibLfoFreq = 1.2f;
+            settings.vibratoOn = false;
+            settings.feedbackFilter.highPassFreq = 120.0f;
+            settings.feedbackFilter.lowPassFreq = 4500.0f;
+            return settings; }() },
+        { "Ping-Pong", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.375f;
+            settings.feedback = 0.55f;
+            settings.feedbackMode = FeedbackMode::PingPong;
+            return settings; }() },
+        { "Shimmer", [] {
+            auto settings = initSettings();
+            settings.delayTime = 0.6f;
+            settings.feedback = 0.6f;
+            settings.delayMode = DelayMode::Granular;
+            settings.grains.density = 8;
+            settings.wetReverb = 0.7f;
+            settings.roomSize = 0.45f;
+            settings.wetReverbOn = false;
+            return settings; }() }
+    };
+
+    constexpr int numFactoryPrograms = (int)(sizeof(factoryPrograms) / sizeof(factoryPrograms[0]));
+}
+
 
 //==============================================================================
 MastersDelayAudioProcessor::MastersDelayAudioProcessor()
@@ -23,10 +219,207 @@ MastersDelayAudioProcessor::MastersDelayAudioProcessor()
                        )
 #endif
 {
+    tapTimes.reserve(maxTapCount);
+
+    auto stagesKey = getStageAssignment(getChainSettings(apvts)).pack();
+    requestedRouting.store(stagesKey);
+    publishRouting(stagesKey);
+
+    // Allocates delay pages requested by the audio thread
+    startTimerHz(20);
 }
 
 MastersDelayAudioProcessor::~MastersDelayAudioProcessor()
 {
+    stopTimer();
+
+    if (deadlineReportPending.exchange(false))
+        logDeadlineReport();
+}
+
+void MastersDelayAudioProcessor::timerCallback()
+{
+    if (delay.delayBuffer.hasPendingRequest())
+        delay.delayBuffer.allocateRequestedPages();
+
+    auto stagesKey = requestedRouting.load(std::memory_order_relaxed);
+    if (stagesKey != compiledRouting)
+        publishRouting(stagesKey);
+
+    dryConvolution.collectGarbage();
+    wetConvolution.collectGarbage();
+
+    RealtimeAudit::logViolations();
+
+    if (deadlineReportPending.exchange(false))
+        logDeadlineReport();
+
+    // The mode and its latency only change together, in prepareToPlay. Until the host
+    // calls it, the reported latency stays the one the engine has; ask once for a restart.
+    auto wantsPipeline = apvts.getRawParameterValue("Pipelined")->load() > 0.5f;
+
+    if (pipelineLatency > 0 && wantsPipeline != pipelined && !pipelineRestartRequested.exchange(true))
+        updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withLatencyChanged(true));
+}
+
+void MastersDelayAudioProcessor::publishRouting(juce::uint32 stagesKey)
+{
+    routings.getWriteBuffer() = RoutingSet::compile(RoutingSpec::unpack(stagesKey));
+    routings.publish();
+    compiledRouting = stagesKey;
+}
+
+const DeadlineMonitor<EngineSnapshot>::WorstBlocks& MastersDelayAudioProcessor::getWorstBlocks()
+{
+    deadlines.worstBlocks.update();
+    return deadlines.worstBlocks.getReadBuffer();
+}
+
+juce::String MastersDelayAudioProcessor::createDeadlineReport()
+{
+    static const char* feedbackModeNames[] = { "Stereo", "Cross-Feed", "Ping-Pong" };
+    static const char* effectNames[NumRoutedEffects] = { "Flanger", "Vibrato", "Chorus", "Wet Reverb" };
+    static const char* simdLevelNames[NumSimdLevels] = { "baseline", "sse2", "avx2", "avx512" };
+
+    auto numBlocks = deadlines.numBlocksMeasured.load();
+    juce::String report;
+
+    report << "Deadline report: " << numBlocks << " blocks, "
+        << deadlines.counts[DeadlineHalf].load() << " over 50%, "
+        << deadlines.counts[DeadlineNear].load() << " over 80%, "
+        << deadlines.counts[DeadlineMissed].load() << " over budget, peak load "
+        << juce::roundToInt(deadlines.peakLoad.load() * 100.0f) << "%";
+
+    if (pipelined)
+        report << ", " << pipeline.getUnderruns() << " pipeline underruns";
+
+    if (getImpulseResponseFile() != juce::File())
+        report << ", " << (dryConvolution.getTailUnderruns() + wetConvolution.getTailUnderruns()) << " convolution tail underruns";
+
+    report << "\n";
+
+    auto& worst = getWorstBlocks();
+
+    for (int i = 0; i < worst.numBlocks; ++i) {
+        auto& block = worst.blocks[(size_t)i];
+        auto& settings = block.snapshot.settings;
+
+        report << "#" << (i + 1) << ": load " << juce::roundToInt(block.load * 100.0f) << "% ("
+            << juce::String(block.costMs, 3) << " of " << juce::String(block.budgetMs, 3) << " ms), "
+            << block.numSamples << " samples at sample " << block.samplePosition
+            << ", block " << block.blockNumber << "\n";
+
+        report << "    delay " << juce::String(settings.delayTime, 3) << " s, feedback " << juce::String(settings.feedback, 2)
+            << ", " << feedbackModeNames[juce::jlimit(0, 2, (int)settings.feedbackMode)]
+            << " (cross-feed " << juce::String(settings.crossFeed, 2) << "), taps " << settings.tapCount
+            << ", feedback filter " << juce::String(settings.feedbackFilter.highPassFreq, 0) << "-"
+            << juce::String(settings.feedbackFilter.lowPassFreq, 0) << " Hz shelf "
+            << juce::String(settings.feedbackFilter.shelfGain, 1) << " dB\n";
+
+        auto routing = RoutingSpec::unpack(block.snapshot.routingKey);
+        report << "    routing:";
+        for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+            auto stage = routing.stages[(size_t)effect];
+            report << " " << effectNames[effect] << (stage > 0 ? "@" + juce::String(stage) : juce::String(" off"));
+        }
+
+        // The on flags are bypass switches
+        report << ", dry reverb " << (settings.dryReverbOn ? "off" : "on")
+            << ", chorus voices " << ((int)settings.numOfVoices + 2)
+            << ", kernels " << simdLevelNames[block.snapshot.simdLevel]
+            << (settings.reverbType == ReverbType::Convolution ? ", convolution reverb" : "")
+            << (block.snapshot.programFading ? ", program fade" : "")
+            << (block.snapshot.dualMono ? ", dual-mono" : "")
+            << (block.snapshot.governorLevel > GovernorFullQuality ? ", governor step " + juce::String(block.snapshot.governorLevel) : juce::String())
+            << (block.snapshot.pipelined ? ", pipelined" : "")
+            << (settings.delayMode == DelayMode::Granular ? ", " + juce::String(block.snapshot.activeGrains) + " grains" : juce::String())
+            << "\n";
+    }
+
+    return report;
+}
+
+bool MastersDelayAudioProcessor::loadImpulseResponse(const juce::File& file)
+{
+    const juce::ScopedLock lock(impulseResponseLock);
+
+    // Not prepared yet: prepareToPlay builds the engines
+    if (getSampleRate() <= 0.0) {
+        impulseResponseFile = file;
+        return file.existsAsFile();
+    }
+
+    if (!buildConvolution(file, getSampleRate(), false))
+        return false;
+
+    impulseResponseFile = file;
+    return true;
+}
+
+void MastersDelayAudioProcessor::clearImpulseResponse()
+{
+    const juce::ScopedLock lock(impulseResponseLock);
+
+    impulseResponseFile = juce::File();
+    builtImpulseResponseFile = juce::File();
+    dryConvolution.setEngine(nullptr);
+    wetConvolution.setEngine(nullptr);
+}
+
+juce::File MastersDelayAudioProcessor::getImpulseResponseFile() const
+{
+    const juce::ScopedLock lock(impulseResponseLock);
+    return impulseResponseFile;
+}
+
+// Leaves the current engines alone if the file cannot be read
+bool MastersDelayAudioProcessor::buildConvolution(const juce::File& file, double sampleRate, bool immediately)
+{
+    juce::AudioBuffer<float> impulse;
+
+    if (file == juce::File() || !readImpulseResponse(file, sampleRate, impulse))
+        return false;
+
+    auto numChannels = getTotalNumInputChannels();
+    auto dryEngine = std::make_unique<ConvolutionEngine>(impulse, numChannels, sampleRate, *kernels);
+    auto wetEngine = std::make_unique<ConvolutionEngine>(impulse, numChannels, sampleRate, *kernels);
+
+    if (immediately) {
+        dryConvolution.setEngineNow(std::move(dryEngine));
+        wetConvolution.setEngineNow(std::move(wetEngine));
+    }
+    else {
+        dryConvolution.setEngine(std::move(dryEngine));
+        wetConvolution.setEngine(std::move(wetEngine));
+    }
+
+    builtImpulseResponseFile = file;
+    builtImpulseResponseRate = sampleRate;
+    builtImpulseResponseChannels = numChannels;
+    return true;
+}
+
+// Returns false when the algorithmic reverb should run instead
+bool MastersDelayAudioProcessor::processConvolution(ConvolutionReverb& reverb, juce::AudioBuffer<float>& target,
+    const juce::Reverb::Parameters& parameters, const ChainSettings& settings, int startSample, int numSamples)
+{
+    if (settings.reverbType != ReverbType::Convolution)
+        return false;
+
+    auto numChannels = juce::jmin(getTotalNumInputChannels(), ConvolutionEngine::maxChannels);
+    float* channels[ConvolutionEngine::maxChannels] = {};
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        channels[channel] = target.getWritePointer(channel, startSample);
+    }
+
+    // Offline blocks wait for the tail thread instead of underrunning
+    return reverb.process(channels, numChannels, numSamples, parameters, isNonRealtime());
+}
+
+void MastersDelayAudioProcessor::logDeadlineReport()
+{
+    juce::Logger::writeToLog(createDeadlineReport());
 }
 
 //==============================================================================
@@ -62,29 +455,61 @@ bool MastersDelayAudioProcessor::isMidiEffect() const
    #endif
 }
 
+// Until the last repeat has decayed by 60 dB and the reverb after it has died away
 double MastersDelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    auto settings = getChainSettings(const_cast<juce::AudioProcessorValueTreeState&>(apvts));
+
+    auto longestDelay = settings.delayTime;
+    for (int tap = 0; tap < settings.tapCount; ++tap) {
+        longestDelay = juce::jmax(longestDelay, settings.taps[(size_t)tap].time * settings.delayTime);
+    }
+
+    // The first repeat comes at full level, every one after it is scaled by the feedback
+    auto repeats = 1.0;
+    if (settings.feedback > 0.0f) {
+        repeats += std::log(0.001) / std::log((double)settings.feedback);
+    }
+
+    auto reverbTail = (settings.dryReverbOn && settings.wetReverbOn) ? 0.0 : reverbTailSeconds;
+
+    return (double)juce::jmin(longestDelay, maxDelayTime) + (repeats - 1.0) * settings.delayTime + reverbTail;
 }
 
 int MastersDelayAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return numFactoryPrograms;
 }
 
 int MastersDelayAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void MastersDelayAudioProcessor::setCurrentProgram (int index)
 {
+    if (!juce::isPositiveAndBelow(index, numFactoryPrograms))
+        return;
+
+    currentProgram = index;
+    auto& settings = factoryPrograms[index].settings;
+
+    // The audio thread switches to the snapshot first and ignores the
+    // parameters until they all hold the new values
+    programParametersSynced.store(false);
+    pendingProgram.store(&settings);
+
+    applyProgramToParameters(settings);
+
+    programParametersSynced.store(true);
 }
 
 const juce::String MastersDelayAudioProcessor::getProgramName (int index)
 {
-    return {};
+    if (!juce::isPositiveAndBelow(index, numFactoryPrograms))
+        return {};
+
+    return factoryPrograms[index].name;
 }
 
 void MastersDelayAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -94,11 +519,12 @@ void MastersDelayAudioProcessor::changeProgramName (int index, const juce::Strin
 //==============================================================================
 void MastersDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {   
-    auto begin = std::chrono::high_resolution_clock::now();
+    // The worker may still be rendering the last block it was given
+    pipeline.stop();
 
     int totalNumInputChannels = getTotalNumInputChannels();
 
-    delay.prepare(sampleRate, totalNumInputChannels, 3.f);
+    delay.prepare(sampleRate, totalNumInputChannels, maxDelayTime, apvts.getRawParameterValue("Delay Time")->load());
 
     flanger.prepare(sampleRate, totalNumInputChannels, 0.0200f + 0.0200f);
     flanger.lfoPhase = 0.f;
@@ -112,20 +538,103 @@ void MastersDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPe
     chorus.lfoPhase = 0.f;
     chorus.inverseSampleRate = 1.f / (float)sampleRate;
 
-    dryReverb.setSampleRate(sampleRate);
-    dryReverb.reset();
+    kernels = &getSimdKernels(getRequestedSimdLevel());
 
-    wetReverb.setSampleRate(sampleRate);
-    wetReverb.reset();
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-    DBG("Processing time: " << duration << " microseconds");
+    // High-rate sessions run the reverbs at half or quarter rate, as far as the quality profile allows
+    auto quality = getQualityProfile(apvts, isNonRealtime() ? QualityOffline : QualityLive);
+    automaticReverbStages = MultiRateReverb::getRequestedStages(sampleRate);
+    auto reverbStages = juce::jmin(automaticReverbStages, quality.maxReverbStages);
+
+    dryReverb.prepare(sampleRate, reverbStages, *kernels);
+    wetReverb.prepare(sampleRate, reverbStages, *kernels);
+
+    {
+        const juce::ScopedLock lock(impulseResponseLock);
+
+        // Same file, rate and layout: the engines only need their state cleared, not a new FFT of the IR
+        if (impulseResponseFile != juce::File() && impulseResponseFile == builtImpulseResponseFile
+            && sampleRate == builtImpulseResponseRate && totalNumInputChannels == builtImpulseResponseChannels) {
+            dryConvolution.resetNow();
+            wetConvolution.resetNow();
+        }
+        else if (!buildConvolution(impulseResponseFile, sampleRate, true)) {
+            dryConvolution.setEngineNow(nullptr);
+            wetConvolution.setEngineNow(nullptr);
+            builtImpulseResponseFile = juce::File();
+        }
+    }
+
+    feedbackFilter.prepare(sampleRate);
+
+    // The engine runs in tiles of at most parameterUpdateInterval samples, whatever samplesPerBlock is
+    multiTap.prepare(totalNumInputChannels, parameterUpdateInterval, *kernels);
+    grainCloud.prepare(totalNumInputChannels, parameterUpdateInterval, sampleRate, *kernels);
+    granularMix = 0.0f;
+    prepareScratchBuffers();
+
+    metering.prepare(sampleRate);
+    spectrumAnalyser.prepare(sampleRate);
+    deadlines.prepare(sampleRate);
+    governor.prepare(sampleRate);
+
+    samplePosition = 0;
+    tapTimes.clear();
+
+    programFadeLength = juce::jmax(parameterUpdateInterval, (int)(0.005 * sampleRate));
+    programFadePosition = 0;
+    programFade = ProgramFade::None;
+
+    // Offline bounces keep the mode too, so the latency the host compensates for stays put
+    pipelineLatency = samplesPerBlock;
+    pipelined = apvts.getRawParameterValue("Pipelined")->load() > 0.5f;
+    setLatencySamples(pipelined ? pipelineLatency : 0);
+    pipelineRestartRequested = false;
+
+    if (pipelined)
+        pipeline.prepare(totalNumInputChannels, pipelineLatency);
 }
 
+// Scratch buffers hold one tile, whatever the host block size
+void MastersDelayAudioProcessor::prepareScratchBuffers()
+{
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto numSamples = parameterUpdateInterval;
+
+    dryRevBufferCopy.setSize(totalNumInputChannels, numSamples);
+    wetRevBufferCopy.setSize(totalNumInputChannels, numSamples);
+    delayOutBuffer.setSize(totalNumInputChannels, numSamples);
+    modOutBuffer.setSize(totalNumInputChannels, numSamples);
+    delayInputBuffer.setSize(totalNumInputChannels, numSamples);
+    feedbackBuffer.setSize(totalNumInputChannels, numSamples);
+    stageInputBuffer.setSize(totalNumInputChannels, numSamples);
+    branchBuffer.setSize(totalNumInputChannels, numSamples);
+    multiTap.tapBuffer.setSize(totalNumInputChannels, numSamples);
+}
+
+// Message thread only, like prepareToPlay: the plugin wrappers call it when the host
+// deactivates the plugin, never from the audio callback. It stops the pipeline worker,
+// frees the delay lines and takes impulseResponseLock.
 void MastersDelayAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    pipeline.stop();
+
+    if (deadlines.counts[DeadlineMissed].load() > 0)
+        deadlineReportPending.store(true);
+
+    // Suspended instances give back the delay lines and the convolution engines, by far
+    // the largest allocations; the next prepareToPlay makes them again
+    delay.release();
+    flanger.release();
+    vibrato.release();
+    chorus.release();
+
+    {
+        const juce::ScopedLock lock(impulseResponseLock);
+
+        dryConvolution.setEngineNow(nullptr);
+        wetConvolution.setEngineNow(nullptr);
+        builtImpulseResponseFile = juce::File();
+    }
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -156,15 +665,191 @@ bool MastersDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
 
 void MastersDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+    if (!pipelined) {
+        processEngineBlock(buffer, midiMessages);
+        return;
+    }
+
+    // The worker renders; this callback only trades blocks with it
+    RealtimeAudit::ScopedAudioThread realtimeAudit;
+    pipeline.exchange(buffer, midiMessages, isNonRealtime());
+    applyPendingDelayTime();
+
+    for (int channel = getTotalNumInputChannels(); channel < getTotalNumOutputChannels(); ++channel)
+        buffer.clear(channel, 0, buffer.getNumSamples());
+}
+
+// The host callback, or the pipeline's worker one block later
+void MastersDelayAudioProcessor::processEngineBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    RealtimeAudit::ScopedAudioThread realtimeAudit;
+    auto blockStart = deadlines.startBlock();
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     auto numSamples = buffer.getNumSamples();
+
+    LevelMeasurement inputLevel, delayLevel, modEffectLevel, reverbLevel, outputLevel;
+    ranDualMono = false;
+
+    //==============================================================================
+    // Split the block at MIDI events and at the parameter update grid.
+    // Every sub-block is processed with constant parameters.
+    //
+    // The sub-blocks are also the tiles the engine works in: every stage, the
+    // metering included, runs on one tile before the next starts, and the scratch
+    // buffers only hold one tile, so they stay in L1 whatever the host block size.
+
+    auto midiIterator = midiMessages.cbegin();
+    int startSample = 0;
+
+    while (startSample < numSamples) {
+        for (; midiIterator != midiMessages.cend() && (*midiIterator).samplePosition <= startSample; ++midiIterator) {
+            handleMidiMessage((*midiIterator).getMessage(), samplePosition + startSample);
+        }
+
+        // On the host callback a MIDI delay time takes effect from its event on
+        if (!pipelined)
+            applyPendingDelayTime();
+
+        auto gridOffset = (int)((samplePosition + startSample) % parameterUpdateInterval);
+        int endSample = juce::jmin(numSamples, startSample + parameterUpdateInterval - gridOffset);
+
+        if (midiIterator != midiMessages.cend()) {
+            endSample = juce::jmin(endSample, (*midiIterator).samplePosition);
+        }
+
+        if (programFade != ProgramFade::None) {
+            endSample = juce::jmin(endSample, startSample + programFadeLength - programFadePosition);
+        }
+
+        auto tileLength = endSample - startSample;
+
+        // Refers to the host buffer; a handful of channels fit its preallocated pointer space
+        juce::AudioBuffer<float> tile(buffer.getArrayOfWritePointers(), totalNumInputChannels, startSample, tileLength);
+
+        inputLevel.add(tile, totalNumInputChannels, tileLength);
+
+        bool analyseTile = totalNumInputChannels > 0 && spectrumAnalyser.canPush(tileLength);
+
+        if (analyseTile) {
+            spectrumAnalyser.pushInput(tile.getReadPointer(0), tileLength);
+        }
+
+        // A bitwise compare is cheap next to running the second channel
+        bool identicalInputs = totalNumInputChannels == FeedbackMatrix::maxChannels
+            && std::memcmp(tile.getReadPointer(0), tile.getReadPointer(1), sizeof(float) * (size_t)tileLength) == 0;
+
+        dualMonoSamples = identicalInputs ? juce::jmin(dualMonoSamples + tileLength, dualMonoHoldSamples) : 0;
+        inputIsDualMono = dualMonoSamples >= dualMonoHoldSamples;
+
+        dryRevBufferCopy.clear(0, tileLength);
+        wetRevBufferCopy.clear(0, tileLength);
+        delayOutBuffer.clear(0, tileLength);
+        modOutBuffer.clear(0, tileLength);
+
+        processSubBlock(tile, 0, tileLength);
+
+        delayLevel.add(delayOutBuffer, totalNumInputChannels, tileLength);
+        modEffectLevel.add(modOutBuffer, totalNumInputChannels, tileLength);
+
+        if (dryReverbActive) {
+            reverbLevel.add(dryRevBufferCopy, totalNumInputChannels, tileLength);
+        }
+        if (wetReverbActive) {
+            reverbLevel.add(wetRevBufferCopy, totalNumInputChannels, tileLength);
+        }
+
+        outputLevel.add(tile, totalNumInputChannels, tileLength);
+
+        if (totalNumInputChannels > 0) {
+            metering.pushScope(tile.getReadPointer(0), tileLength);
+        }
+
+        if (analyseTile) {
+            spectrumAnalyser.pushWet(wetRevBufferCopy.getReadPointer(0), tileLength);
+        }
+
+        startSample = endSample;
+    }
+
+    for (; midiIterator != midiMessages.cend(); ++midiIterator) {
+        handleMidiMessage((*midiIterator).getMessage(), samplePosition + numSamples);
+    }
+
+    if (!pipelined)
+        applyPendingDelayTime();
+
+    samplePosition += numSamples;
+
+    for (int channel = totalNumInputChannels; channel < totalNumOutputChannels; ++channel)
+        buffer.clear(channel, 0, numSamples);
+
+    //==============================================================================
+    // METERING
+
+    metering.publish(MeterStage::Input, inputLevel);
+    metering.publish(MeterStage::DelayOut, delayLevel);
+    metering.publish(MeterStage::ModEffectOut, modEffectLevel);
+    metering.publish(MeterStage::ReverbOut, reverbLevel);
+    metering.publish(MeterStage::Output, outputLevel);
+
+    EngineSnapshot snapshot;
+    snapshot.settings = lastSettings;
+    snapshot.routingKey = (activeRouting != nullptr) ? activeRouting->key : 0;
+    snapshot.simdLevel = kernels->level;
+    snapshot.programFading = programFade != ProgramFade::None;
+    snapshot.dualMono = ranDualMono;
+    snapshot.governorLevel = governor.level.load(std::memory_order_relaxed);
+    snapshot.pipelined = pipelined;
+    snapshot.activeGrains = grainCloud.getNumActive();
+
+    // Offline blocks have no deadline; their cost would only skew the counts
+    if (!isNonRealtime()) {
+        deadlines.endBlock(blockStart, numSamples, samplePosition - numSamples, snapshot);
+        governor.update(deadlines.lastLoad.load(std::memory_order_relaxed), numSamples,
+            dryReverb.isSettled() && wetReverb.isSettled());
+    }
+}
+
+void MastersDelayAudioProcessor::processSubBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto endSample = startSample + numSamples;
     auto sampleRate = getSampleRate();
 
-    auto chainSettings = getChainSettings(apvts);
-    int caseOfProcessing = 0;
+    auto chainSettings = getEngineSettings();
+
+    // Live, the load governor can take the profile further down
+    auto quality = getQualityProfile(apvts, isNonRealtime() ? QualityOffline : QualityLive);
+    bool governed = !isNonRealtime();
+
+    if (governed && governor.hasReached(GovernorInterpolation)) {
+        quality.interpolation = (InterpolationQuality)juce::jmax((int)InterpolationLinear, (int)quality.interpolation - 1);
+    }
+    if (governed && governor.hasReached(GovernorLfoResolution)) {
+        quality.lfoInterval = juce::jmax(quality.lfoInterval, lfoIntervals[2]);
+    }
+
+    for (auto* line : { &delay, &flanger, &vibrato, &chorus }) {
+        line->setInterpolation(quality.interpolation);
+        line->lfoInterval = quality.lfoInterval;
+    }
+
+    // Live, the reverbs take a new rate at once in silence, else through a crossfade.
+    // Offline they take it on the spot, so a bounce runs at the offline rate from
+    // its first block even when isNonRealtime flips without a prepareToPlay.
+    auto governedReverbStages = juce::jmin(automaticReverbStages, quality.maxReverbStages)
+        + ((governed && governor.hasReached(GovernorReverbRate)) ? 1 : 0);
+
+    if (governed) {
+        dryReverb.setStages(governedReverbStages);
+        wetReverb.setStages(governedReverbStages);
+    }
+    else {
+        dryReverb.setStagesNow(governedReverbStages);
+        wetReverb.setStagesNow(governedReverbStages);
+    }
 
     auto delayTime = chainSettings.delayTime;
     auto feedback = chainSettings.feedback;
@@ -172,24 +857,152 @@ void MastersDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     auto wetLevel = chainSettings.wetLevel;
     delay.prepareSmoothing(delayTime, sampleRate);
 
-    auto flangDelay = chainSettings.flangDelay;
-    auto flangWidth = chainSettings.flangWidth;
-    auto flangDepth = chainSettings.flangDepth;
-    auto flangFeedback = chainSettings.flangFeedback;
-    auto flangLfoFreq = chainSettings.flangLfoFreq;
-    flanger.prepareSmoothing(flangDelay, sampleRate, flangWidth);
-    
-    auto vibWidth = chainSettings.vibWidth;
-    auto vibLfoFreq = chainSettings.vibLfoFreq;
-    auto vibDepth = chainSettings.vibDepth;
-    vibrato.prepareSmoothing(vibWidth, sampleRate);
-
-    auto chorDelay = chainSettings.chorDelay;
-    auto chorWidth = chainSettings.chorWidth;
-    auto chorDepth = chainSettings.chorDepth;
-    auto chorLfoFreq = chainSettings.chorLfoFreq;
-    auto numOfVoices = chainSettings.numOfVoices;
-    chorus.prepareSmoothing(chorDelay, sampleRate, chorWidth);
+    // Ask for the pages this delay time needs, and the farther reach of the grains
+    // past it; until they arrive the delay and the grains are held at the committed
+    // length. Offline renders allocate on the spot.
+    auto minGrainDistance = (GrainCloud::maxRatio + 1.0f) * (float)parameterUpdateInterval + (float)DelayLineEffect::guardSamples;
+    auto delayReach = delay.currentDelayTime;
+
+    if (chainSettings.delayMode == DelayMode::Granular || granularMix > 0.0f) {
+        delayReach = juce::jmax(delayReach, grainCloud.getReach(chainSettings.grains, delay.currentDelayTime, minGrainDistance));
+    }
+
+    delay.delayBuffer.requestLength((int)delayReach + DelayLineEffect::guardSamples);
+    if (isNonRealtime() && delay.delayBuffer.hasPendingRequest()) {
+        // Offline blocks have no deadline, so the audit lets this allocation through
+        RealtimeAudit::ScopedExemption offlineAllocation;
+        delay.delayBuffer.allocateRequestedPages();
+    }
+    delay.commitPages();
+    delay.currentDelayTime = juce::jmin(delay.currentDelayTime, delay.getMaxDelayInSamples());
+
+    feedbackFilter.setSettings(chainSettings.feedbackFilter);
+
+    // Routings are compiled on the timer, a set of every bypass combination per
+    // stage assignment, so bypass switches apply at once. After a stage change
+    // the previous assignment keeps running until its set arrives; offline
+    // renders compile on the spot.
+    auto stagesKey = getStageAssignment(chainSettings).pack();
+
+    if (routings.update() || activeRoutings == nullptr) {
+        activeRoutings = &routings.getReadBuffer();
+    }
+
+    activeRouting = &activeRoutings->get(getBypassMask(chainSettings));
+
+    if (activeRoutings->stagesKey != stagesKey) {
+        if (isNonRealtime()) {
+            offlineRouting = RoutingProgram::compile(getRoutingSpec(chainSettings));
+            activeRouting = &offlineRouting;
+        }
+        else {
+            requestedRouting.store(stagesKey, std::memory_order_relaxed);
+        }
+    }
+
+    // Dual-mono: channel 0 runs alone and the other channel is copied from it
+    processedChannels = (inputIsDualMono && canRunDualMono(chainSettings)) ? 1 : totalNumInputChannels;
+    ranDualMono = ranDualMono || processedChannels < totalNumInputChannels;
+
+    // Granular repeats fade in and out across tiles. Grains, like the taps, only read
+    // samples written before this sub-block, so the whole cloud is rendered up front.
+    auto granularMixFrom = granularMix;
+    auto granularTarget = (chainSettings.delayMode == DelayMode::Granular) ? 1.0f : 0.0f;
+    auto granularStep = (float)numSamples / (float)granularFadeSamples;
+    granularMix = (granularTarget > granularMix) ? juce::jmin(granularTarget, granularMix + granularStep)
+                                                 : juce::jmax(granularTarget, granularMix - granularStep);
+    auto granularMixSlope = (granularMix - granularMixFrom) / (float)numSamples;
+
+    bool renderGrains = juce::jmax(granularMixFrom, granularMix) > 0.0f;
+    bool readCleanRepeats = juce::jmin(granularMixFrom, granularMix) < 1.0f;
+
+    if (renderGrains) {
+        grainCloud.beginTile(chainSettings.grains, delay.currentDelayTime, minGrainDistance, delay.getMaxDelayInSamples(), numSamples);
+        for (int channel = 0; channel < processedChannels; ++channel) {
+            grainCloud.render(delay, channel, numSamples);
+        }
+        grainCloud.endTile(numSamples);
+    }
+    else if (grainCloud.getNumActive() > 0) {
+        grainCloud.reset();
+    }
+
+    // The repeats of one channel for the whole sub-block: the clean reads, the grains,
+    // or a blend while fading. The delay is far longer than a sub-block, so like the
+    // taps the clean reads only see samples written before it and run as one batch.
+    auto readRepeats = [&](int channel, float* destination)
+        {
+            const float* grainData = renderGrains ? grainCloud.grainBuffer.getReadPointer(channel) : nullptr;
+
+            if (readCleanRepeats)
+                delay.readTile(channel, delay.currentDelayTime, destination + startSample, numSamples, *kernels);
+
+            if (grainData == nullptr)
+                return;
+
+            for (int sample = startSample; sample < endSample; ++sample) {
+                auto mix = granularMixFrom + granularMixSlope * (float)(sample - startSample);
+                destination[sample] = readCleanRepeats ? destination[sample] + mix * (grainData[sample] - destination[sample]) : grainData[sample];
+            }
+        };
+
+    // Taps only read samples written before this sub-block, so they run as a batch up front
+    auto tapCount = chainSettings.tapCount;
+    if (tapCount > 0) {
+        auto minTapDelay = (float)(parameterUpdateInterval + DelayLineEffect::guardSamples);
+
+        for (int channel = 0; channel < processedChannels; ++channel) {
+            multiTap.process(delay, channel, totalNumInputChannels, chainSettings.taps, tapCount,
+                delay.currentDelayTime, minTapDelay, startSample, numSamples);
+        }
+    }
+
+    // Matrix modes and feedback filtering: the shortest delay is far longer than a
+    // sub-block, so the lines' outputs for the whole sub-block can be read up front,
+    // filtered and mixed into the line inputs before the per-channel pass writes anything
+    bool canProcessAsBlock = totalNumInputChannels <= FeedbackMatrix::maxChannels;
+    bool useFeedbackMatrix = chainSettings.feedbackMode != FeedbackMode::Stereo
+        && totalNumInputChannels == FeedbackMatrix::maxChannels;
+
+    bool useDelayInputs = canProcessAsBlock && (useFeedbackMatrix || feedbackFilter.isActive());
+
+    if (useDelayInputs) {
+        jassert(delay.currentDelayTime > (float)(numSamples + DelayLineEffect::guardSamples));
+
+        const float* inputs[FeedbackMatrix::maxChannels] = {};
+        const float* delayed[FeedbackMatrix::maxChannels] = {};
+        float* filtered[FeedbackMatrix::maxChannels] = {};
+        float* destinations[FeedbackMatrix::maxChannels] = {};
+
+        for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+            inputs[channel] = buffer.getReadPointer(channel, startSample);
+            filtered[channel] = feedbackBuffer.getWritePointer(channel, startSample);
+            destinations[channel] = delayInputBuffer.getWritePointer(channel, startSample);
+
+            // A skipped dual-mono channel reuses channel 0's repeats, which keeps
+            // the filter lanes in step and the cross-feed matrix symmetric
+            if (channel >= processedChannels) {
+                delayed[channel] = delayed[0];
+                continue;
+            }
+
+            readRepeats(channel, delayOutBuffer.getWritePointer(channel));
+            delayed[channel] = delayOutBuffer.getReadPointer(channel, startSample);
+        }
+
+        // Only the repeats are shaped, the wet output keeps the unfiltered first tap
+        if (feedbackFilter.isActive()) {
+            feedbackFilter.process(delayed, filtered, totalNumInputChannels, numSamples);
+            std::copy(std::begin(filtered), std::end(filtered), std::begin(delayed));
+        }
+
+        feedbackMatrix.setMode(useFeedbackMatrix ? chainSettings.feedbackMode : FeedbackMode::Stereo, chainSettings.crossFeed, feedback);
+        feedbackMatrix.process(inputs, delayed, destinations, totalNumInputChannels, numSamples, *kernels);
+    }
+
+    flanger.prepareSmoothing(chainSettings.flangDelay, sampleRate, chainSettings.flangWidth);
+    vibrato.prepareSmoothing(chainSettings.vibWidth, sampleRate);
+    chorus.prepareSmoothing(chainSettings.chorDelay, sampleRate, chainSettings.chorWidth);
 
     auto dryRev = chainSettings.dryReverb;
     auto wetRev = chainSettings.wetReverb;
@@ -197,12 +1010,7 @@ void MastersDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     auto damping = chainSettings.damping;
     auto revWidth = chainSettings.revWidth;
 
-    bool flangerIsOn = chainSettings.flangerOn;
-    bool vibratoIsOn = chainSettings.vibratoOn;
-    bool chorusIsOn = chainSettings.chorusOn;
-
     auto dryReverbOn = chainSettings.dryReverbOn;
-    auto wetReverbOn = chainSettings.wetReverbOn;
 
     dryRevParams.wetLevel = dryRev;
     dryRevParams.roomSize = roomSize;
@@ -210,8 +1018,6 @@ void MastersDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     dryRevParams.width = revWidth;
     dryRevParams.dryLevel = 0.5f;
     dryReverb.setParameters(dryRevParams);
-    dryRevBufferCopy.setSize(totalNumInputChannels, numSamples);
-    dryRevBufferCopy.clear();
 
     wetRevParams.wetLevel = wetRev;
     wetRevParams.roomSize = roomSize;
@@ -219,193 +1025,454 @@ void MastersDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     wetRevParams.width = revWidth;
     wetRevParams.dryLevel = 0.5f;
     wetReverb.setParameters(wetRevParams);
-    wetRevBufferCopy.setSize(totalNumInputChannels, numSamples);
-    wetRevBufferCopy.clear();
+
+    dryReverbActive = !dryReverbOn;
+    wetReverbActive = activeRouting->uses(RoutedWetReverb);
 
     //==============================================================================
     //PROCESSING
 
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+    auto writeStart = delay.writePosition;
+
+    for (int channel = 0; channel < processedChannels; ++channel) {
         float* channelData = buffer.getWritePointer(channel);
+        float* delayOutData = delayOutBuffer.getWritePointer(channel);
+        const float* delayInputData = useDelayInputs ? delayInputBuffer.getReadPointer(channel) : nullptr;
+
+        // The block pass above has read this sub-block's repeats already
+        if (!useDelayInputs)
+            readRepeats(channel, delayOutData);
 
         delay.prepareDelayBuffer(channel);
-        flanger.prepareDelayBuffer(channel, true);
-        vibrato.prepareDelayBuffer(channel, true);
-        chorus.prepareDelayBuffer(channel, true);
 
-        for (int sample = 0; sample < numSamples; ++sample) {
+        for (int sample = startSample; sample < endSample; ++sample) {
             const float in = channelData[sample];
 
-            dryRevBufferCopy.addSample(channel, sample, in);        
+            delay.write((delayInputData != nullptr) ? delayInputData[sample] : in + delayOutData[sample] * feedback);
+            delay.calculatePositionAndPhase();
+        }
 
-            if (!flangerIsOn) {
-                caseOfProcessing = 1;
-                
-            }
-            else if (!vibratoIsOn) {
-                caseOfProcessing = 2;
-                
-            }
-            else if (!chorusIsOn) {
-                caseOfProcessing = 3;
-                
-            }
-            else {
-                caseOfProcessing = 0;
-            }
+        dryRevBufferCopy.copyFrom(channel, startSample, buffer, channel, startSample, numSamples);
 
-            switch (caseOfProcessing) {
-                case 0: {
-                    delay.process(delay.currentDelayTime);
+        if (tapCount > 0) {
+            delayOutBuffer.addFrom(channel, startSample, multiTap.tapBuffer, channel, startSample, numSamples);
+        }
 
-                    delay.delayData[delay.localWritePosition] = in + delay.out * feedback;
-                    
-                    if (wetReverbOn) {
-                        channelData[sample] = channelData[sample] * dryLevel + delay.out *  wetLevel;
-                    }
+        wetRevBufferCopy.copyFrom(channel, startSample, delayOutBuffer, channel, startSample, numSamples);
+    }
 
-                    wetRevBufferCopy.addSample(channel, sample, delay.out);
+    delay.updatePositionAndPhase();
+    delay.syncChannels(writeStart, numSamples, processedChannels);
 
-                    break;
-                }
-                case 1: {
-                    delay.process(delay.currentDelayTime);
+    if (readCleanRepeats)
+        delay.advanceInterpolationFade(numSamples);
 
-                    float localFlangerDelayTime = flanger.currentDelayTime + flanger.currentWidth * flanger.lfo();
-                    flanger.process(localFlangerDelayTime);
+    for (int channel = processedChannels; channel < totalNumInputChannels; ++channel) {
+        dryRevBufferCopy.copyFrom(channel, startSample, buffer, channel, startSample, numSamples);
+    }
+    duplicateProcessedChannel(delayOutBuffer, startSample, numSamples);
 
-                    delay.delayData[delay.localWritePosition] = delay.out + flanger.out * flangDepth;
-                    flanger.delayData[flanger.localWritePosition] = delay.out + flanger.out * flangFeedback;
+    runRouting(*activeRouting, chainSettings, startSample, numSamples);
+    expandDualMono(startSample, numSamples);
 
-                    delay.delayData[delay.localWritePosition] = in + delay.out * feedback;
-                    
+    if (!dryReverbOn && !processConvolution(dryConvolution, dryRevBufferCopy, dryRevParams, chainSettings, startSample, numSamples)) {
+        if (totalNumInputChannels == 1) {
+            dryReverb.processMono(dryRevBufferCopy.getWritePointer(0, startSample), numSamples);
+        }
+        else if (totalNumInputChannels == 2) {
+            dryReverb.processStereo(dryRevBufferCopy.getWritePointer(0, startSample), dryRevBufferCopy.getWritePointer(1, startSample), numSamples);
+        }
+    }
 
-                    if (wetReverbOn) {
-                        channelData[sample] = channelData[sample] * dryLevel + (flanger.out * flangDepth + delay.out) *  wetLevel;
-                    }
+    if (programFade != ProgramFade::None) {
+        mixProgramFade(buffer, startSample, numSamples, dryLevel, wetLevel);
+        return;
+    }
 
-                    wetRevBufferCopy.addSample(channel, sample, delay.out + flanger.out * flangDepth);
+    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+        kernels->mix(buffer.getWritePointer(channel, startSample),
+            dryRevBufferCopy.getReadPointer(channel, startSample), dryLevel,
+            wetRevBufferCopy.getReadPointer(channel, startSample), wetLevel, numSamples);
+    }
+}
 
+// Settings that treat the channels differently rule the fast path out, and so do
+// channel states that have not matched since the inputs last differed. The LFOs
+// and chorus voices share their phase across channels, so they never do.
+bool MastersDelayAudioProcessor::canRunDualMono(const ChainSettings& settings) const
+{
+    if (settings.feedbackMode == FeedbackMode::PingPong)
+        return false;
 
-                    break;
+    for (int tap = 0; tap < settings.tapCount; ++tap) {
+        if (settings.taps[(size_t)tap].pan != 0.0f)
+            return false;
+    }
+
+    if (!delay.channelsMatched || !feedbackFilter.channelsMatch())
+        return false;
+
+    return (!activeRouting->uses(RoutedFlanger) || flanger.channelsMatched)
+        && (!activeRouting->uses(RoutedVibrato) || vibrato.channelsMatched)
+        && (!activeRouting->uses(RoutedChorus) || chorus.channelsMatched);
+}
+
+void MastersDelayAudioProcessor::duplicateProcessedChannel(juce::AudioBuffer<float>& target, int startSample, int numSamples)
+{
+    for (int channel = processedChannels; channel < getTotalNumInputChannels(); ++channel) {
+        target.copyFrom(channel, startSample, target, 0, startSample, numSamples);
+    }
+}
+
+// The first stage that makes the signal stereo ends dual-mono for the rest of the
+// sub-block; every buffer that carries on from there gets channel 0 copied across
+void MastersDelayAudioProcessor::expandDualMono(int startSample, int numSamples)
+{
+    if (processedChannels >= getTotalNumInputChannels())
+        return;
+
+    duplicateProcessedChannel(wetRevBufferCopy, startSample, numSamples);
+    duplicateProcessedChannel(stageInputBuffer, startSample, numSamples);
+    duplicateProcessedChannel(branchBuffer, startSample, numSamples);
+    duplicateProcessedChannel(modOutBuffer, startSample, numSamples);
+
+    processedChannels = getTotalNumInputChannels();
+}
+
+void MastersDelayAudioProcessor::runRouting(const RoutingProgram& routing, const ChainSettings& settings, int startSample, int numSamples)
+{
+    for (int i = 0; i < routing.numOps; ++i) {
+        auto& op = routing.ops[(size_t)i];
+
+        switch (op.code) {
+            case RoutingProgram::SaveStageInput:
+                for (int channel = 0; channel < processedChannels; ++channel) {
+                    stageInputBuffer.copyFrom(channel, startSample, wetRevBufferCopy, channel, startSample, numSamples);
+                }
+                break;
+            case RoutingProgram::ProcessMain:
+                processRoutedEffect(op.effect, wetRevBufferCopy, settings, startSample, numSamples);
+                break;
+            case RoutingProgram::ProcessBranch:
+                for (int channel = 0; channel < processedChannels; ++channel) {
+                    branchBuffer.copyFrom(channel, startSample, stageInputBuffer, channel, startSample, numSamples);
+                }
+                processRoutedEffect(op.effect, branchBuffer, settings, startSample, numSamples);
+                break;
+            case RoutingProgram::ScaleMain:
+                for (int channel = 0; channel < processedChannels; ++channel) {
+                    wetRevBufferCopy.applyGain(channel, startSample, numSamples, op.gain);
                 }
-                case 2: {
-                    delay.process(delay.currentDelayTime);
+                break;
+            case RoutingProgram::AccumulateBranch:
+                for (int channel = 0; channel < processedChannels; ++channel) {
+                    kernels->addWithMultiply(wetRevBufferCopy.getWritePointer(channel, startSample),
+                        branchBuffer.getReadPointer(channel, startSample), op.gain, numSamples);
+                }
+                break;
+        }
+    }
+}
 
-                    float localVibratoDelayTime = vibrato.currentDelayTime * vibrato.lfo(true);
-                    vibrato.process(localVibratoDelayTime);
+// Each kernel runs one effect over a whole sub-block, in place on target
+void MastersDelayAudioProcessor::processRoutedEffect(RoutedEffect effect, juce::AudioBuffer<float>& target,
+    const ChainSettings& settings, int startSample, int numSamples)
+{
+    switch (effect) {
+        case RoutedFlanger: {
+            auto writeStart = flanger.writePosition;
 
-                    vibrato.delayData[vibrato.localWritePosition] = delay.out;
+            for (int channel = 0; channel < processedChannels; ++channel) {
+                float* data = target.getWritePointer(channel, startSample);
+                float* modOutData = modOutBuffer.getWritePointer(channel, startSample);
+                flanger.prepareDelayBuffer(channel, true);
 
-                    delay.delayData[delay.localWritePosition] = in + delay.out * feedback;
+                for (int sample = 0; sample < numSamples; ++sample) {
+                    const float in = data[sample];
 
-                    if (wetReverbOn) {
-                        channelData[sample] = channelData[sample] * dryLevel + (vibDepth * vibrato.out) *  wetLevel;
-                    }
+                    float localFlangerDelayTime = flanger.currentDelayTime + flanger.currentWidth * flanger.lfo();
+                    flanger.process(localFlangerDelayTime);
+                    flanger.write(in + flanger.out * settings.flangFeedback);
 
-                    wetRevBufferCopy.addSample(channel, sample, vibDepth * vibrato.out);
+                    data[sample] = in + flanger.out * settings.flangDepth;
+                    modOutData[sample] += flanger.out * settings.flangDepth;
 
-                    break;
+                    flanger.calculatePositionAndPhase(settings.flangLfoFreq);
                 }
-                case 3: {
-                    delay.process(delay.currentDelayTime);
-                    chorus.phaseOffset = 0.0f;
+            }
 
-                    for (int voice = 0; voice < numOfVoices + 1; ++voice) {
-                        if ((numOfVoices + 2) > 2) {
-                            chorus.weight = (float)(voice) / (float)(numOfVoices);
-                            if (channel != 0) {
-                                chorus.weight = 1.0f - chorus.weight;
-                            }
-                        }
-                        else {
-                            chorus.weight = 1.0f;
-                        }
+            flanger.updatePositionAndPhase(true);
+            flanger.syncChannels(writeStart, numSamples, processedChannels);
+            break;
+        }
+        case RoutedVibrato: {
+            auto writeStart = vibrato.writePosition;
 
-                        float localChorusDelayTime = chorus.currentDelayTime + chorus.currentWidth * chorus.lfo();
+            for (int channel = 0; channel < processedChannels; ++channel) {
+                float* data = target.getWritePointer(channel, startSample);
+                float* modOutData = modOutBuffer.getWritePointer(channel, startSample);
+                vibrato.prepareDelayBuffer(channel, true);
 
-                        chorus.process(localChorusDelayTime);
+                for (int sample = 0; sample < numSamples; ++sample) {
+                    const float in = data[sample];
 
-                        if ((numOfVoices + 2) == 2) {
-                            delay.delayData[delay.localWritePosition] = (channel == 0) ? delay.out : chorus.out * chorDepth;
-                        }
-                        else {
-                            delay.delayData[delay.localWritePosition] = chorus.out * chorDepth * chorus.weight;
-                        }
+                    float localVibratoDelayTime = vibrato.currentDelayTime * vibrato.lfo(true);
+                    vibrato.process(localVibratoDelayTime);
+                    vibrato.write(in);
 
-                        if ((numOfVoices + 2) == 3) {
-                            chorus.phaseOffset += 0.25f;
-                        }
-                        else if ((numOfVoices + 2) > 3) {
-                            chorus.phaseOffset += 1.0f / (float)(numOfVoices + 1);
-                        }
-                    }
+                    data[sample] = settings.vibDepth * vibrato.out;
+                    modOutData[sample] += settings.vibDepth * vibrato.out;
 
-                    chorus.delayData[chorus.localWritePosition] = delay.out;
+                    vibrato.calculatePositionAndPhase(settings.vibLfoFreq);
+                }
+            }
 
-                    delay.delayData[delay.localWritePosition] = in + delay.out * feedback;
+            vibrato.updatePositionAndPhase(true);
+            vibrato.syncChannels(writeStart, numSamples, processedChannels);
+            break;
+        }
+        case RoutedChorus: {
+            // Only the last voice reaches the output; its LFO sits after all the voice offsets
+            auto numOfVoices = settings.numOfVoices;
+            float voiceOffset = 0.0f;
+            if ((numOfVoices + 2) == 3) {
+                voiceOffset = 0.25f;
+            }
+            else if ((numOfVoices + 2) > 3) {
+                voiceOffset = 1.0f / (float)(numOfVoices + 1);
+            }
+            chorus.phaseOffset = voiceOffset * (float)numOfVoices;
+
+            auto writeStart = chorus.writePosition;
 
-                    if (wetReverbOn) {
-                        channelData[sample] = channelData[sample] * dryLevel + (chorDepth * chorus.out + delay.out) *  wetLevel;
-                    }
+            for (int channel = 0; channel < processedChannels; ++channel) {
+                float* data = target.getWritePointer(channel, startSample);
+                float* modOutData = modOutBuffer.getWritePointer(channel, startSample);
+                chorus.prepareDelayBuffer(channel, true);
 
-                    wetRevBufferCopy.addSample(channel, sample, delay.out + chorDepth * chorus.out);
+                for (int sample = 0; sample < numSamples; ++sample) {
+                    const float in = data[sample];
 
+                    float localChorusDelayTime = chorus.currentDelayTime + chorus.currentWidth * chorus.lfo();
+                    chorus.process(localChorusDelayTime);
+                    chorus.write(in);
 
-                    break;
+                    data[sample] = in + settings.chorDepth * chorus.out;
+                    modOutData[sample] += settings.chorDepth * chorus.out;
+
+                    chorus.calculatePositionAndPhase(settings.chorLfoFreq);
                 }
             }
 
-            delay.calculatePositionAndPhase();
-            flanger.calculatePositionAndPhase(flangLfoFreq);
-            vibrato.calculatePositionAndPhase(vibLfoFreq);
-            chorus.calculatePositionAndPhase(chorLfoFreq);
+            chorus.updatePositionAndPhase(true);
+            chorus.syncChannels(writeStart, numSamples, processedChannels);
+            break;
         }
-    }
+        case RoutedWetReverb: {
+            auto totalNumInputChannels = getTotalNumInputChannels();
+            expandDualMono(startSample, numSamples);
 
-    delay.updatePositionAndPhase();
-    flanger.updatePositionAndPhase(true);
-    vibrato.updatePositionAndPhase(true);
-    chorus.updatePositionAndPhase(true);
+            if (processConvolution(wetConvolution, target, wetRevParams, settings, startSample, numSamples))
+                break;
 
-    if (!dryReverbOn) {
-        if (totalNumInputChannels == 1) {
-            dryReverb.processMono(dryRevBufferCopy.getWritePointer(0), numSamples);
+            if (totalNumInputChannels == 1) {
+                wetReverb.processMono(target.getWritePointer(0, startSample), numSamples);
+            }
+            else if (totalNumInputChannels == 2) {
+                wetReverb.processStereo(target.getWritePointer(0, startSample), target.getWritePointer(1, startSample), numSamples);
+            }
+            break;
         }
-        else if (totalNumInputChannels == 2) {
-            dryReverb.processStereo(dryRevBufferCopy.getWritePointer(0), dryRevBufferCopy.getWritePointer(1), numSamples);
+        default:
+            break;
+    }
+}
+
+ChainSettings MastersDelayAudioProcessor::getEngineSettings()
+{
+    if (programFade == ProgramFade::None) {
+        if (auto* program = pendingProgram.exchange(nullptr)) {
+            incomingProgram = program;
+            programFade = ProgramFade::FadingOut;
+            programFadePosition = 0;
         }
     }
 
-    if (!wetReverbOn) {
-        if (totalNumInputChannels == 1) {
-            wetReverb.processMono(wetRevBufferCopy.getWritePointer(0), numSamples);
+    if (programFade == ProgramFade::FadingOut)
+        return lastSettings;
+
+    if (programOverride != nullptr) {
+        if (programFade == ProgramFade::None && programParametersSynced.load()) {
+            programOverride = nullptr;
         }
-        else if (totalNumInputChannels == 2) {
-            wetReverb.processStereo(wetRevBufferCopy.getWritePointer(0), wetRevBufferCopy.getWritePointer(1), numSamples);
+        else {
+            lastSettings = *programOverride;
+            return lastSettings;
         }
     }
 
-    if (!dryReverbOn || !wetReverbOn) {
-        for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-            float* channelData = buffer.getWritePointer(channel);
-            float* directCopyData = dryRevBufferCopy.getWritePointer(channel);
-            float* delayCopyData = wetRevBufferCopy.getWritePointer(channel);
+    auto settings = getChainSettings(apvts);
 
-            for (int sample = 0; sample < numSamples; ++sample) {
-                channelData[sample] = directCopyData[sample] * dryLevel + delayCopyData[sample] * wetLevel;
-            }
+    // A program change started while the parameters were being read
+    if (pendingProgram.load() != nullptr)
+        return lastSettings;
+
+    lastSettings = settings;
+    return settings;
+}
+
+// The final mix while a program change runs. Only the engine's output fades; the
+// dry signal carries on and glides from the old program's level to the new one's
+// while the new program fades in.
+void MastersDelayAudioProcessor::mixProgramFade(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+    float dryLevel, float wetLevel)
+{
+    auto startGain = (float)programFadePosition / (float)programFadeLength;
+    auto endGain = (float)(programFadePosition + numSamples) / (float)programFadeLength;
+    auto dryStart = dryLevel, dryEnd = dryLevel;
+
+    if (programFade == ProgramFade::FadingOut) {
+        startGain = 1.0f - startGain;
+        endGain = 1.0f - endGain;
+        programFadeDryLevel = dryLevel;
+    }
+    else {
+        dryStart = juce::jmap(startGain, programFadeDryLevel, dryLevel);
+        dryEnd = juce::jmap(endGain, programFadeDryLevel, dryLevel);
+    }
+
+    for (int channel = 0; channel < getTotalNumInputChannels(); ++channel) {
+        buffer.copyFromWithRamp(channel, startSample, dryRevBufferCopy.getReadPointer(channel, startSample), numSamples, dryStart, dryEnd);
+        buffer.addFromWithRamp(channel, startSample, wetRevBufferCopy.getReadPointer(channel, startSample), numSamples,
+            wetLevel * startGain, wetLevel * endGain);
+    }
+
+    programFadePosition += numSamples;
+
+    if (programFadePosition >= programFadeLength) {
+        programFadePosition = 0;
+
+        if (programFade == ProgramFade::FadingOut) {
+            programFade = ProgramFade::FadingIn;
+            programOverride = incomingProgram;
+        }
+        else {
+            programFade = ProgramFade::None;
         }
     }
-    for (int channel = totalNumInputChannels; channel < totalNumOutputChannels; ++channel)
-        buffer.clear(channel, 0, numSamples);
-    
-    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+}
+
+void MastersDelayAudioProcessor::applyProgramToParameters(const ChainSettings& settings)
+{
+    auto setParameter = [this](const juce::String& parameterID, float value)
+        {
+            auto* param = apvts.getParameter(parameterID);
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+        };
+
+    setParameter("Delay Time", settings.delayTime);
+    setParameter("Feedback", settings.feedback);
+    setParameter("Dry Level", settings.dryLevel);
+    setParameter("Wet Level", settings.wetLevel);
+
+    setParameter("Flanger Delay", settings.flangDelay);
+    setParameter("Flanger Width", settings.flangWidth);
+    setParameter("Flanger Depth", settings.flangDepth);
+    setParameter("Flanger Feedback", settings.flangFeedback);
+    setParameter("Flanger LFO Frequency", settings.flangLfoFreq);
+
+    setParameter("Vibrato Width", settings.vibWidth);
+    setParameter("Vibrato Depth", settings.vibDepth);
+    setParameter("Vibrato LFO Frequency", settings.vibLfoFreq);
+
+    setParameter("Chorus Delay", settings.chorDelay);
+    setParameter("Chorus Width", settings.chorWidth);
+    setParameter("Chorus Depth", settings.chorDepth);
+    setParameter("Chorus LFO Frequency", settings.chorLfoFreq);
+    setParameter("Number of Voices", (float)settings.numOfVoices);
+
+    setParameter("Dry Reverb", settings.dryReverb);
+    setParameter("Wet Reverb", settings.wetReverb);
+    setParameter("Room Size", settings.roomSize);
+    setParameter("Damping", settings.damping);
+    setParameter("Reverb Width", settings.revWidth);
+
+    setParameter("Flanger On", settings.flangerOn ? 1.0f : 0.0f);
+    setParameter("Vibrato On", settings.vibratoOn ? 1.0f : 0.0f);
+    setParameter("Chorus On", settings.chorusOn ? 1.0f : 0.0f);
+    setParameter("Dry Reverb On", settings.dryReverbOn ? 1.0f : 0.0f);
+    setParameter("Wet Reverb On", settings.wetReverbOn ? 1.0f : 0.0f);
+
+    setParameter("Tap Count", (float)settings.tapCount);
+    for (int tap = 0; tap < MultiTapDelay::maxTaps; ++tap) {
+        auto& tapSettings = settings.taps[(size_t)tap];
+        setParameter(getTapParameterID(tap, TapTime), tapSettings.time);
+        setParameter(getTapParameterID(tap, TapGain), tapSettings.gain);
+        setParameter(getTapParameterID(tap, TapPan), tapSettings.pan);
+    }
+
+    setParameter("Feedback Mode", (float)settings.feedbackMode);
+    setParameter("Cross Feed", settings.crossFeed);
 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds > (end - begin).count();
-    DBG(duration);
-    
+    setParameter("Feedback High-Pass", settings.feedbackFilter.highPassFreq);
+    setParameter("Feedback Low-Pass", settings.feedbackFilter.lowPassFreq);
+    setParameter("Feedback Shelf", settings.feedbackFilter.shelfGain);
+
+    for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+        setParameter(effectStageIDs[effect], (float)settings.effectStages[(size_t)effect]);
+    }
+
+    setParameter("Reverb Type", (float)settings.reverbType);
+
+    setParameter("Delay Mode", (float)settings.delayMode);
+    setParameter("Grain Pitch", settings.grains.pitch);
+    setParameter("Grain Size", settings.grains.size);
+    setParameter("Grain Density", (float)settings.grains.density);
+    setParameter("Grain Spray", settings.grains.spray);
 }
+
+void MastersDelayAudioProcessor::handleMidiMessage(const juce::MidiMessage& message, juce::int64 timeInSamples)
+{
+    auto timeInSeconds = (double)timeInSamples / getSampleRate();
+
+    if (message.isNoteOn()) {
+        registerTap(timeInSeconds);
+    }
+    else if (message.isControllerOfType(delayTimeController)) {
+        pendingDelayTime.store((float)message.getControllerValue() / 127.f, std::memory_order_relaxed);
+    }
+    else if (message.isControllerOfType(tapTempoController) && message.getControllerValue() >= 64) {
+        registerTap(timeInSeconds);
+    }
+}
+
+void MastersDelayAudioProcessor::registerTap(double timeInSeconds)
+{
+    if (!tapTimes.empty() && timeInSeconds - tapTimes.back() > tapTimeout) {
+        tapTimes.clear();
+    }
+
+    if ((int)tapTimes.size() >= maxTapCount) {
+        tapTimes.erase(tapTimes.begin());
+    }
+
+    tapTimes.push_back(timeInSeconds);
+
+    if (tapTimes.size() >= 2) {
+        auto averageInterval = (tapTimes.back() - tapTimes.front()) / (double)(tapTimes.size() - 1);
+        pendingDelayTime.store(delayTimeParameter->convertTo0to1((float)averageInterval), std::memory_order_relaxed);
+    }
+}
+
+// The host callback only: the pipeline's worker must not call into the host
+void MastersDelayAudioProcessor::applyPendingDelayTime()
+{
+    auto value = pendingDelayTime.exchange(-1.0f, std::memory_order_relaxed);
+
+    if (value >= 0.0f)
+        delayTimeParameter->setValueNotifyingHost(value);
+}
+
 //==============================================================================
 // HELP FUNCTIONS
 
@@ -418,7 +1485,8 @@ void MastersDelayAudioProcessor::turnOnFlangerAndEffects()
 
 void MastersDelayAudioProcessor::setDelayTimeFromTapTempo(float delayTime)
 {
-    apvts.getParameter("Delay Time")->setValueNotifyingHost(delayTime);
+    auto* delayTimeParam = apvts.getParameter("Delay Time");
+    delayTimeParam->setValueNotifyingHost(delayTimeParam->convertTo0to1(delayTime));
 }
 
 //void MastersDelayAudioProcessor::setParameterNotifyingHost(float newValue)
@@ -442,17 +1510,74 @@ juce::AudioProcessorEditor* MastersDelayAudioProcessor::createEditor()
 //==============================================================================
 void MastersDelayAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    auto& parameterIDs = getStateParameterIDs();
+    destData.setSize(sizeof(int) * 3 + sizeof(float) * (size_t)parameterIDs.size());
+
+    juce::MemoryOutputStream mos(destData, false);
+    mos.writeInt(stateMagic);
+    mos.writeInt(stateVersion);
+    mos.writeInt(parameterIDs.size());
+
+    for (auto& parameterID : parameterIDs) {
+        mos.writeFloat(apvts.getRawParameterValue(parameterID)->load());
+    }
+
+    mos.writeString(getImpulseResponseFile().getFullPathName());
 }
 
 void MastersDelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
-    if (tree.isValid())
+    juce::MemoryInputStream mis(data, (size_t)sizeInBytes, false);
+
+    if (sizeInBytes < (int)sizeof(int) * 3 || mis.readInt() != stateMagic)
+    {
+        // Sessions saved before the binary format store the whole ValueTree
+        auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
+        if (tree.isValid())
+        {
+            apvts.replaceState(tree);
+            clearImpulseResponse();
+        }
+        return;
+    }
+
+    auto version = mis.readInt();
+    auto numStored = mis.readInt();
+
+    if (version < 1 || version > stateVersion || numStored < 0)
     {
-        apvts.replaceState(tree);
+        jassertfalse;
+        return;
+    }
+
+    auto& parameterIDs = getStateParameterIDs();
+
+    for (int i = 0; i < parameterIDs.size(); ++i) {
+        auto* param = apvts.getParameter(parameterIDs[i]);
+
+        if (i < numStored && !mis.isExhausted()) {
+            param->setValueNotifyingHost(param->convertTo0to1(mis.readFloat()));
+        }
+        else {
+            param->setValueNotifyingHost(param->getDefaultValue());
+        }
+    }
+
+    // Sessions from before version 6 had no impulse response, and one that cannot
+    // be loaded must not leave the previous session's playing
+    juce::String impulseResponsePath;
+
+    if (version >= 6) {
+        for (int i = parameterIDs.size(); i < numStored; ++i) {
+            mis.readFloat();
+        }
+
+        impulseResponsePath = mis.readString();
     }
+
+    if (impulseResponsePath.isEmpty() || !juce::File::isAbsolutePath(impulseResponsePath)
+        || !loadImpulseResponse(juce::File(impulseResponsePath)))
+        clearImpulseResponse();
 }
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
@@ -492,14 +1617,103 @@ ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
     settings.dryReverbOn = apvts.getRawParameterValue("Dry Reverb On")->load() > 0.5f;
     settings.wetReverbOn = apvts.getRawParameterValue("Wet Reverb On")->load() > 0.5f;
 
+    settings.tapCount = (int)apvts.getRawParameterValue("Tap Count")->load();
+    for (int tap = 0; tap < settings.tapCount; ++tap) {
+        auto& tapSettings = settings.taps[(size_t)tap];
+        tapSettings.time = apvts.getRawParameterValue(getTapParameterID(tap, TapTime))->load();
+        tapSettings.gain = apvts.getRawParameterValue(getTapParameterID(tap, TapGain))->load();
+        tapSettings.pan = apvts.getRawParameterValue(getTapParameterID(tap, TapPan))->load();
+    }
+
+    settings.feedbackMode = static_cast<FeedbackMode>(apvts.getRawParameterValue("Feedback Mode")->load());
+    settings.crossFeed = apvts.getRawParameterValue("Cross Feed")->load();
+
+    settings.feedbackFilter.highPassFreq = apvts.getRawParameterValue("Feedback High-Pass")->load();
+    settings.feedbackFilter.lowPassFreq = apvts.getRawParameterValue("Feedback Low-Pass")->load();
+    settings.feedbackFilter.shelfGain = apvts.getRawParameterValue("Feedback Shelf")->load();
+
+    for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+        settings.effectStages[(size_t)effect] = (int)apvts.getRawParameterValue(effectStageIDs[effect])->load();
+    }
+
+    settings.reverbType = static_cast<ReverbType>(apvts.getRawParameterValue("Reverb Type")->load());
+
+    settings.delayMode = static_cast<DelayMode>(apvts.getRawParameterValue("Delay Mode")->load());
+    settings.grains.pitch = apvts.getRawParameterValue("Grain Pitch")->load();
+    settings.grains.size = apvts.getRawParameterValue("Grain Size")->load();
+    settings.grains.density = (int)apvts.getRawParameterValue("Grain Density")->load();
+    settings.grains.spray = apvts.getRawParameterValue("Grain Spray")->load();
+
     return settings;
 }
 
+RoutingSpec getRoutingSpec(const ChainSettings& settings)
+{
+    return getStageAssignment(settings).withBypass(getBypassMask(settings));
+}
+
+RoutingSpec getStageAssignment(const ChainSettings& settings)
+{
+    RoutingSpec spec;
+    spec.stages = settings.effectStages;
+
+    return spec;
+}
+
+juce::uint32 getBypassMask(const ChainSettings& settings)
+{
+    // The "On" flags are bypass switches
+    const bool bypassed[] = { settings.flangerOn, settings.vibratoOn, settings.chorusOn, settings.wetReverbOn };
+
+    juce::uint32 bypassMask = 0;
+    for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+        if (bypassed[effect])
+            bypassMask |= 1u << effect;
+    }
+
+    return bypassMask;
+}
+
+QualityProfile getQualityProfile(juce::AudioProcessorValueTreeState& apvts, QualityTier tier)
+{
+    QualityProfile profile;
+
+    profile.interpolation = static_cast<InterpolationQuality>(apvts.getRawParameterValue(interpolationIDs[tier])->load());
+    profile.lfoInterval = lfoIntervals[juce::jlimit(0, 2, (int)apvts.getRawParameterValue(lfoResolutionIDs[tier])->load())];
+    profile.maxReverbStages = (int)apvts.getRawParameterValue(reverbRateIDs[tier])->load();
+
+    return profile;
+}
+
+const juce::String& getTapParameterID(int tap, TapParameter parameter)
+{
+    // Built once so the audio thread never assembles strings
+    static const auto parameterIDs = []
+        {
+            std::array<std::array<juce::String, 3>, MultiTapDelay::maxTaps> ids;
+
+            for (int i = 0; i < MultiTapDelay::maxTaps; ++i) {
+                auto prefix = "Tap " + juce::String(i + 1);
+                ids[(size_t)i][TapTime] = prefix + " Time";
+                ids[(size_t)i][TapGain] = prefix + " Gain";
+                ids[(size_t)i][TapPan] = prefix + " Pan";
+            }
+
+            return ids;
+        }();
+
+    return parameterIDs[(size_t)tap][(size_t)parameter];
+}
+
 juce::AudioProcessorValueTreeState::ParameterLayout MastersDelayAudioProcessor::createParameterLayout()
 {
     juce::AudioProcessorValueTreeState::ParameterLayout layout;
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Delay Time", "Delay Time", juce::NormalisableRange<float>(0.1f, 3.0f, 0.001f, 1.f), 0.5f));
+    // Was 0.1 s to 3 s, linear. States store plain values and load unchanged, but host
+    // automation and MIDI CC 12 are normalised, so lanes recorded before play other times.
+    juce::NormalisableRange<float> delayTimeRange(0.1f, maxDelayTime, 0.001f, 1.f);
+    delayTimeRange.setSkewForCentre(1.0f);
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Delay Time", "Delay Time", delayTimeRange, 0.5f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("Feedback", "Feedback", juce::NormalisableRange<float>(0.0f, 0.90f, 0.001f, 1.f), 0.45f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("Dry Level", "Dry Level", juce::NormalisableRange<float>(0.0f, 1.00f, 0.01f, 1.f), 1.00f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("Wet Level", "Wet Level", juce::NormalisableRange<float>(0.0f, 1.00f, 0.01f, 1.f), 0.50f));
@@ -538,6 +1752,83 @@ juce::AudioProcessorValueTreeState::ParameterLayout MastersDelayAudioProcessor::
     layout.add(std::make_unique<juce::AudioParameterBool>("Dry Reverb On", "Dry Reverb On", true));
     layout.add(std::make_unique<juce::AudioParameterBool>("Wet Reverb On", "Wet Reverb On", true));
 
+    juce::StringArray reverbTypeArray;
+    reverbTypeArray.add("Algorithmic");
+    reverbTypeArray.add("Convolution");
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Reverb Type", "Reverb Type", reverbTypeArray, 0));
+
+    // One block of latency buys the engine a whole buffer period on its own core
+    layout.add(std::make_unique<juce::AudioParameterBool>("Pipelined", "Pipelined", false));
+
+    // Granular repeats are pitch-shifted again on every pass through the feedback, so +12 shimmers
+    juce::StringArray delayModeArray;
+    delayModeArray.add("Clean");
+    delayModeArray.add("Granular");
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Delay Mode", "Delay Mode", delayModeArray, 0));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Grain Pitch", "Grain Pitch", juce::NormalisableRange<float>(-GrainCloud::maxPitch, GrainCloud::maxPitch, 0.01f, 1.f), 12.0f));
+    juce::NormalisableRange<float> grainSizeRange(0.02f, 0.50f, 0.001f, 1.f);
+    grainSizeRange.setSkewForCentre(0.12f);
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Grain Size", "Grain Size", grainSizeRange, 0.12f));
+    layout.add(std::make_unique<juce::AudioParameterInt>("Grain Density", "Grain Density", 1, GrainCloud::maxGrains, 4));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Grain Spray", "Grain Spray", juce::NormalisableRange<float>(0.00f, 0.25f, 0.001f, 1.f), 0.02f));
+
+    // Live playback takes the cheap end, offline bounces the expensive one
+    juce::StringArray interpolationArray;
+    interpolationArray.add("Linear");
+    interpolationArray.add("Cubic");
+    interpolationArray.add("Lagrange");
+    juce::StringArray lfoResolutionArray;
+    lfoResolutionArray.add("Every Sample");
+    lfoResolutionArray.add("Every 4 Samples");
+    lfoResolutionArray.add("Every 16 Samples");
+    juce::StringArray reverbRateArray;
+    reverbRateArray.add("Full");
+    reverbRateArray.add("Half");
+    reverbRateArray.add("Quarter");
+
+    const int defaultInterpolation[NumQualityTiers] = { InterpolationCubic, InterpolationLagrange };
+    const int defaultLfoResolution[NumQualityTiers] = { 1, 0 };
+    const int defaultReverbRate[NumQualityTiers] = { MultiRateReverb::maxStages, 0 };
+
+    for (int tier = 0; tier < NumQualityTiers; ++tier) {
+        layout.add(std::make_unique<juce::AudioParameterChoice>(interpolationIDs[tier], interpolationIDs[tier], interpolationArray, defaultInterpolation[tier]));
+        layout.add(std::make_unique<juce::AudioParameterChoice>(lfoResolutionIDs[tier], lfoResolutionIDs[tier], lfoResolutionArray, defaultLfoResolution[tier]));
+        layout.add(std::make_unique<juce::AudioParameterChoice>(reverbRateIDs[tier], reverbRateIDs[tier], reverbRateArray, defaultReverbRate[tier]));
+    }
+
+    juce::StringArray feedbackModeArray;
+    feedbackModeArray.add("Stereo");
+    feedbackModeArray.add("Cross-Feed");
+    feedbackModeArray.add("Ping-Pong");
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Feedback Mode", "Feedback Mode", feedbackModeArray, 0));
+    // Effects sharing a stage run in parallel, stages run in series
+    for (int effect = 0; effect < NumRoutedEffects; ++effect) {
+        layout.add(std::make_unique<juce::AudioParameterInt>(effectStageIDs[effect], effectStageIDs[effect], 1, RoutingSpec::maxStages, effect + 1));
+    }
+
+    // At 20 Hz / 20 kHz / 0 dB the corresponding section drops out of the cascade
+    juce::NormalisableRange<float> highPassRange(FeedbackFilter::highPassOff, 2000.0f, 1.0f, 1.f);
+    highPassRange.setSkewForCentre(200.0f);
+    juce::NormalisableRange<float> lowPassRange(1000.0f, FeedbackFilter::lowPassOff, 1.0f, 1.f);
+    lowPassRange.setSkewForCentre(5000.0f);
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Feedback High-Pass", "Feedback High-Pass", highPassRange, FeedbackFilter::highPassOff));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Feedback Low-Pass", "Feedback Low-Pass", lowPassRange, FeedbackFilter::lowPassOff));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Feedback Shelf", "Feedback Shelf", juce::NormalisableRange<float>(-12.0f, 12.0f, 0.1f, 1.f), 0.0f));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Cross Feed", "Cross Feed", juce::NormalisableRange<float>(0.00f, 1.00f, 0.01f, 1.f), 0.50f));
+
+    // Tap times are fractions of the delay time, so the taps follow tap tempo and sync
+    layout.add(std::make_unique<juce::AudioParameterInt>("Tap Count", "Tap Count", 0, MultiTapDelay::maxTaps, 0));
+    for (int tap = 0; tap < MultiTapDelay::maxTaps; ++tap) {
+        auto& timeID = getTapParameterID(tap, TapTime);
+        auto& gainID = getTapParameterID(tap, TapGain);
+        auto& panID = getTapParameterID(tap, TapPan);
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(timeID, timeID, juce::NormalisableRange<float>(0.01f, 1.00f, 0.001f, 1.f), getDefaultTapTime(tap)));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(gainID, gainID, juce::NormalisableRange<float>(0.00f, 1.00f, 0.01f, 1.f), 0.70f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(panID, panID, juce::NormalisableRange<float>(-1.00f, 1.00f, 0.01f, 1.f), 0.00f));
+    }
+
     return layout;
 }
 
@@ -9,55 +9,125 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include <chrono>
+#include <cstring>
+#include "Metering.h"
+#include "SpectrumAnalyser.h"
+#include "TripleBuffer.h"
+#include "PagedDelayBuffer.h"
+#include "FeedbackFilter.h"
+#include "EffectRouter.h"
+#include "SimdKernels.h"
+#include "RealtimeAudit.h"
+#include "DeadlineMonitor.h"
+#include "MultiRateReverb.h"
+#include "ConvolutionReverb.h"
+#include "LoadGovernor.h"
+#include "BlockPipeline.h"
 
 
 using SmoothedValue = juce::SmoothedValue<float, juce::ValueSmoothingTypes::Linear>;
 
-using DelayBuffer = juce::AudioBuffer<float>;
+enum InterpolationQuality
+{
+    InterpolationLinear,
+    InterpolationCubic,
+    InterpolationLagrange
+};
 
 struct DelayLineEffect
 {
-    DelayBuffer delayBuffer;
+    PagedDelayBuffer delayBuffer;
     SmoothedValue smoothedDelay;
     SmoothedValue smoothedWidth;
 
+    // Long lines are split into pages of 2^15 samples, short ones use a single page
+    static constexpr int maxPageShift = 15;
+    static constexpr int guardSamples = 4;
+
     int bufferChannels;
     int bufferSize;
     int writePosition;
 
-    float* delayData;
+    float* const* delayPages;
+    int pageShift;
+    int pageMask;
     float currentDelayTime;
     float currentWidth;
 
     int localWritePosition;
-    float readPosition;
+    float fraction;
     int localReadPosition;
 
     float out;
     float phase;
     float phaseOffset = 0.0f;;
     float lfoPhase;
+    float phaseIncrement = 0.0f;
+    int lfoCountdown = 0;
+    float lfoValue = 0.0f, lfoEnd = 0.0f, lfoSlope = 0.0f;
     float inverseSampleRate;
     const float twoPi = juce::MathConstants<float>::twoPi;
     float weight;
 
-    void prepare(int sampleRate, int totalNumInputChannels, float maxDelayTime)
+    // Set per sub-block from the quality profile. A new interpolation kernel
+    // is crossfaded in over interpolationFadeSamples.
+    static constexpr int interpolationFadeSamples = 256;
+    InterpolationQuality interpolation = InterpolationCubic;
+    InterpolationQuality previousInterpolation = InterpolationCubic;
+    int interpolationFade = 0;
+    int localInterpolationFade = 0;
+    int lfoInterval = 1;
+
+    // Scratch for readTile, which works in chunks of readChunk samples
+    static constexpr int readChunk = 64;
+    std::array<float, readChunk + 5> readWindow{};
+    std::array<float, readChunk> fadeWindow{};
+
+    // Dual-mono bookkeeping: channel 0 can stand in for the others once every sample in the ring matches
+    int matchingWrites = 0;
+    bool channelsMatched = true;
+
+    // initialDelayTime > 0 only commits the pages needed for that delay, the rest follow on request
+    void prepare(double sampleRate, int totalNumInputChannels, float maxDelayTime, float initialDelayTime = 0.0f)
     {
         smoothedDelay.reset(sampleRate, 1e-3);
         smoothedWidth.reset(sampleRate, 1e-3);
 
-        bufferSize = (int)(maxDelayTime * sampleRate) + 1;
-        if (bufferSize < 1)
-            bufferSize = 1;
+        int maxLength = (int)(maxDelayTime * sampleRate) + guardSamples;
+        int initialLength = (initialDelayTime > 0.0f) ? (int)(initialDelayTime * sampleRate) + guardSamples : maxLength;
         bufferChannels = totalNumInputChannels;
-        delayBuffer.setSize(bufferChannels, bufferSize);
-        delayBuffer.clear();
+
+        pageShift = juce::jmin(PagedDelayBuffer::getPageShiftForLength(maxLength), maxPageShift);
+        pageMask = (1 << pageShift) - 1;
+        delayBuffer.prepare(bufferChannels, maxLength, initialLength, pageShift);
+        bufferSize = delayBuffer.getLength();
 
         writePosition = 0;
+        matchingWrites = 0;
+        channelsMatched = true;
+    }
+
+    // While suspended: the next prepare allocates again
+    void release()
+    {
+        delayBuffer.release();
+        bufferSize = 0;
+        delayPages = nullptr;
+    }
+
+    // Between sub-blocks: takes in pages allocated since the last call
+    void commitPages()
+    {
+        delayBuffer.commitReadyPages(writePosition);
+        bufferSize = delayBuffer.getLength();
+    }
+
+    float getMaxDelayInSamples() const
+    {
+        return (float)(bufferSize - guardSamples);
     }
 
-    void prepareSmoothing(float delayTime, int sampleRate, float width = 0) 
+    void prepareSmoothing(float delayTime, double sampleRate, float width = 0) 
     {
         smoothedDelay.setTargetValue((float)delayTime);
         currentDelayTime = smoothedDelay.getTargetValue() * (float)sampleRate;
@@ -70,35 +140,181 @@ struct DelayLineEffect
 
     void prepareDelayBuffer(int channel, bool useLfo = false)
     {
-        delayData = delayBuffer.getWritePointer(channel);
+        delayPages = delayBuffer.getPages(channel);
         localWritePosition = writePosition;
+        localInterpolationFade = interpolationFade;
 
         if (useLfo) {
             phase = lfoPhase;
+            lfoCountdown = 0;
+            lfoEnd = sinf(twoPi * (phase + phaseOffset));
         }
     }
 
+    float& sampleAt(int index)
+    {
+        return delayPages[index >> pageShift][index & pageMask];
+    }
+
+    void write(float value)
+    {
+        sampleAt(localWritePosition) = value;
+    }
+
+    // Copies numSamples starting at startIndex (may be negative) out of the ring
+    void readBlock(int channel, int startIndex, float* destination, int numSamples) const
+    {
+        auto* pages = delayBuffer.getPages(channel);
+        int index = ((startIndex % bufferSize) + bufferSize) % bufferSize;
+
+        while (numSamples > 0) {
+            int offsetInPage = index & pageMask;
+            int run = juce::jmin(numSamples, pageMask + 1 - offsetInPage, bufferSize - index);
+
+            juce::FloatVectorOperations::copy(destination, pages[index >> pageShift] + offsetInPage, run);
+
+            destination += run;
+            numSamples -= run;
+            index += run;
+            if (index >= bufferSize)
+                index = 0;
+        }
+    }
+
+    // After a pass that wrote numSamples from startPosition: channels the pass skipped
+    // get channel 0's samples, the others are compared with it. New pages are zero on
+    // every channel, so a ring that matched keeps matching when it grows.
+    void syncChannels(int startPosition, int numSamples, int numProcessedChannels)
+    {
+        bool matching = true;
+        auto* sourcePages = delayBuffer.getPages(0);
+
+        for (int channel = 1; channel < bufferChannels; ++channel) {
+            auto* pages = delayBuffer.getPages(channel);
+            int index = startPosition;
+            int remaining = numSamples;
+
+            while (remaining > 0) {
+                int offsetInPage = index & pageMask;
+                int run = juce::jmin(remaining, pageMask + 1 - offsetInPage, bufferSize - index);
+                auto* source = sourcePages[index >> pageShift] + offsetInPage;
+                auto* destination = pages[index >> pageShift] + offsetInPage;
+
+                if (channel >= numProcessedChannels)
+                    juce::FloatVectorOperations::copy(destination, source, run);
+                else if (matching)
+                    matching = std::memcmp(destination, source, sizeof(float) * (size_t)run) == 0;
+
+                remaining -= run;
+                index += run;
+                if (index >= bufferSize)
+                    index = 0;
+            }
+        }
+
+        matchingWrites = matching ? juce::jmin(matchingWrites + numSamples, bufferSize) : 0;
+        channelsMatched = matching && (channelsMatched || matchingWrites >= bufferSize);
+    }
+
     void process(float currentDelayTime)
     {
         out = 0.0f;
-        readPosition = fmodf((float)localWritePosition - currentDelayTime + (float)bufferSize, bufferSize);
-        localReadPosition = floorf(readPosition);
+
+        // Whole and fractional delay are kept apart so long lines keep sub-sample precision
+        int wholeDelay = (int)ceilf(currentDelayTime);
+        fraction = (float)wholeDelay - currentDelayTime;
+
+        localReadPosition = localWritePosition - wholeDelay;
+        if (localReadPosition < 0)
+            localReadPosition += bufferSize;
 
         if (localReadPosition != localWritePosition) {
-            out = cubicInterpolation();
+            out = interpolate(interpolation);
+
+            if (localInterpolationFade > 0) {
+                auto previousWeight = (float)localInterpolationFade / (float)interpolationFadeSamples;
+                out += previousWeight * (interpolate(previousInterpolation) - out);
+            }
         }
+
+        if (localInterpolationFade > 0)
+            --localInterpolationFade;
+    }
+
+    // Reads a whole tile of repeats at a fixed delay, like process() once per sample.
+    // Everything the tile reads was written before it, so each interpolation kernel
+    // is a short FIR over a contiguous run of the ring and runs as one SIMD kernel
+    // pass, as the taps do. The delay must be longer than numSamples + 3.
+    void readTile(int channel, float delayInSamples, float* destination, int numSamples, const SimdKernels& kernels)
+    {
+        jassert(delayInSamples > (float)(numSamples + 3));
+
+        int wholeDelay = (int)ceilf(delayInSamples);
+        auto tileFraction = (float)wholeDelay - delayInSamples;
+
+        for (int offset = 0; offset < numSamples; offset += readChunk) {
+            auto num = juce::jmin(readChunk, numSamples - offset);
+            auto readStart = writePosition + offset - wholeDelay;
+            auto fade = interpolationFade - offset;
+
+            readInterpolated(channel, interpolation, readStart, tileFraction, destination + offset, num, kernels);
+
+            if (fade > 0) {
+                readInterpolated(channel, previousInterpolation, readStart, tileFraction, fadeWindow.data(), num, kernels);
+
+                for (int sample = 0; sample < num && fade - sample > 0; ++sample) {
+                    auto previousWeight = (float)(fade - sample) / (float)interpolationFadeSamples;
+                    destination[offset + sample] += previousWeight * (fadeWindow[(size_t)sample] - destination[offset + sample]);
+                }
+            }
+        }
+    }
+
+    // Once per sub-block after its readTile calls, which leave the fade where it was
+    void advanceInterpolationFade(int numSamples)
+    {
+        interpolationFade = juce::jmax(0, interpolationFade - numSamples);
+    }
+
+    void setInterpolation(InterpolationQuality newInterpolation)
+    {
+        if (newInterpolation == interpolation)
+            return;
+
+        previousInterpolation = interpolation;
+        interpolation = newInterpolation;
+        interpolationFade = interpolationFadeSamples;
+    }
+
+    float interpolate(InterpolationQuality quality)
+    {
+        switch (quality) {
+            case InterpolationLinear:
+                return linearInterpolation();
+            case InterpolationLagrange:
+                return lagrangeInterpolation();
+            default:
+                return cubicInterpolation();
+        }
+    }
+
+    float linearInterpolation()
+    {
+        float sample1 = sampleAt(localReadPosition);
+        float sample2 = sampleAt((localReadPosition + 1) % bufferSize);
+
+        return sample1 + fraction * (sample2 - sample1);
     }
 
     float cubicInterpolation()
     {
-        float fraction = readPosition - (float)localReadPosition;
         float fractionSqrt = fraction * fraction;
         float fractionCube = fractionSqrt * fraction;
 
-        float sample0 = delayData[(localReadPosition - 1 + bufferSize) % bufferSize];
-        float sample1 = delayData[(localReadPosition + 0)];
-        float sample2 = delayData[(localReadPosition + 1) % bufferSize];
-        float sample3 = delayData[(localReadPosition + 2) % bufferSize];
+        float sample0 = sampleAt((localReadPosition - 1 + bufferSize) % bufferSize);
+        float sample1 = sampleAt(localReadPosition + 0);
+        float sample2 = sampleAt((localReadPosition + 1) % bufferSize);
+        float sample3 = sampleAt((localReadPosition + 2) % bufferSize);
 
         float a0 = -0.5f * sample0 + 1.5f * sample1 - 1.5f * sample2 + 0.5f * sample3;
         float a1 = sample0 - 2.5f * sample1 + 2.0f * sample2 - 0.5f * sample3;
@@ -109,13 +325,104 @@ struct DelayLineEffect
         return out;
     }
 
+    // The kernel as FIR coefficients over the samples from readStart + the returned
+    // offset on, matching interpolate() to within rounding
+    static int getInterpolationCoefficients(InterpolationQuality quality, float d, float* coefficients)
+    {
+        switch (quality) {
+            case InterpolationLinear:
+                coefficients[0] = 1.0f - d;
+                coefficients[1] = d;
+                coefficients[2] = coefficients[3] = 0.0f;
+                return 0;
+            case InterpolationLagrange: {
+                float dp2 = d + 2.0f, dp1 = d + 1.0f, dm1 = d - 1.0f, dm2 = d - 2.0f, dm3 = d - 3.0f;
+
+                coefficients[0] = -dp1 * d * dm1 * dm2 * dm3 * (1.0f / 120.0f);
+                coefficients[1] = dp2 * d * dm1 * dm2 * dm3 * (1.0f / 24.0f);
+                coefficients[2] = -dp2 * dp1 * dm1 * dm2 * dm3 * (1.0f / 12.0f);
+                coefficients[3] = dp2 * dp1 * d * dm2 * dm3 * (1.0f / 12.0f);
+                coefficients[4] = -dp2 * dp1 * d * dm1 * dm3 * (1.0f / 24.0f);
+                coefficients[5] = dp2 * dp1 * d * dm1 * dm2 * (1.0f / 120.0f);
+                return -2;
+            }
+            default: {
+                float dSqrt = d * d;
+                float dCube = dSqrt * d;
+
+                coefficients[0] = -0.5f * dCube + dSqrt - 0.5f * d;
+                coefficients[1] = 1.5f * dCube - 2.5f * dSqrt + 1.0f;
+                coefficients[2] = -1.5f * dCube + 2.0f * dSqrt + 0.5f * d;
+                coefficients[3] = 0.5f * dCube - 0.5f * dSqrt;
+                return -1;
+            }
+        }
+    }
+
+    // Up to readChunk interpolated samples read from readStart on, overwriting destination
+    void readInterpolated(int channel, InterpolationQuality quality, int readStart, float d, float* destination,
+        int numSamples, const SimdKernels& kernels)
+    {
+        float coefficients[6];
+        auto firstOffset = getInterpolationCoefficients(quality, d, coefficients);
+        auto numTaps = (quality == InterpolationLagrange) ? 6 : 4;
+
+        readBlock(channel, readStart + firstOffset, readWindow.data(), numSamples + numTaps - 1);
+        juce::FloatVectorOperations::clear(destination, numSamples);
+
+        if (numTaps == 6)
+            kernels.addFir6(destination, readWindow.data(), coefficients, numSamples);
+        else
+            kernels.addFir4(destination, readWindow.data(), coefficients, numSamples);
+    }
+
+    // Fifth-order Lagrange over six points around the read position, for offline renders
+    float lagrangeInterpolation()
+    {
+        float d = fraction;
+        float dp2 = d + 2.0f, dp1 = d + 1.0f, dm1 = d - 1.0f, dm2 = d - 2.0f, dm3 = d - 3.0f;
+
+        float sampleM2 = sampleAt((localReadPosition - 2 + bufferSize) % bufferSize);
+        float sampleM1 = sampleAt((localReadPosition - 1 + bufferSize) % bufferSize);
+        float sample0 = sampleAt(localReadPosition);
+        float sample1 = sampleAt((localReadPosition + 1) % bufferSize);
+        float sample2 = sampleAt((localReadPosition + 2) % bufferSize);
+        float sample3 = sampleAt((localReadPosition + 3) % bufferSize);
+
+        float out = -sampleM2 * dp1 * d * dm1 * dm2 * dm3 * (1.0f / 120.0f)
+            + sampleM1 * dp2 * d * dm1 * dm2 * dm3 * (1.0f / 24.0f)
+            - sample0 * dp2 * dp1 * dm1 * dm2 * dm3 * (1.0f / 12.0f)
+            + sample1 * dp2 * dp1 * d * dm2 * dm3 * (1.0f / 12.0f)
+            - sample2 * dp2 * dp1 * d * dm1 * dm3 * (1.0f / 24.0f)
+            + sample3 * dp2 * dp1 * d * dm1 * dm2 * (1.0f / 120.0f);
+
+        return out;
+    }
+
+    // With lfoInterval > 1 the sine is only evaluated every lfoInterval samples
+    // and followed in straight lines between
     float lfo(bool vibrato = false)
     {
         float out = 0.0f;
 
         float factor = (vibrato) ? 0.1f : 0.25f;
 
-        out = 0.5f + factor * sinf(twoPi * (phase + phaseOffset));
+        if (lfoInterval <= 1) {
+            out = 0.5f + factor * sinf(twoPi * (phase + phaseOffset));
+            return out;
+        }
+
+        if (--lfoCountdown < 0) {
+            lfoValue = lfoEnd;
+            lfoEnd = sinf(twoPi * (phase + phaseOffset + phaseIncrement * (float)lfoInterval));
+            lfoSlope = (lfoEnd - lfoValue) / (float)lfoInterval;
+            lfoCountdown = lfoInterval - 1;
+        }
+        else {
+            lfoValue += lfoSlope;
+        }
+
+        out = 0.5f + factor * lfoValue;
         return out;
     }
 
@@ -124,7 +431,8 @@ struct DelayLineEffect
         if (++localWritePosition >= bufferSize)
             localWritePosition -= bufferSize;
 
-        phase += lfoFreq * inverseSampleRate;
+        phaseIncrement = lfoFreq * inverseSampleRate;
+        phase += phaseIncrement;
         if (phase >= 1.0f)
             phase -= 1.0f;
     }
@@ -132,12 +440,393 @@ struct DelayLineEffect
     void updatePositionAndPhase(bool useLfo = false)
     {
         writePosition = localWritePosition;
+        interpolationFade = localInterpolationFade;
         if (useLfo) {
             lfoPhase = phase;
         }
     }
 };
 
+struct DelayTapSettings
+{
+    float time{ 1.0f }, gain{ 0.7f }, pan{ 0.0f };
+};
+
+enum TapParameter
+{
+    TapTime,
+    TapGain,
+    TapPan
+};
+
+struct MultiTapDelay
+{
+    static constexpr int maxTaps = 16;
+    static constexpr int windowChunk = 64;
+
+    juce::AudioBuffer<float> tapBuffer;
+
+    void prepare(int numChannels, int samplesPerBlock, const SimdKernels& simdKernels)
+    {
+        tapBuffer.setSize(numChannels, samplesPerBlock);
+        tapBuffer.clear();
+        kernels = &simdKernels;
+    }
+
+    // Renders all taps of one channel into tapBuffer. Every tap has to reach back
+    // further than numSamples + 2, so the samples it reads are already written.
+    // At a fixed tap delay the cubic interpolation is a 4-point FIR over contiguous
+    // samples, so each tap is one vectorised 4-tap FIR pass over the block.
+    void process(const DelayLineEffect& line, int channel, int numChannels,
+        const std::array<DelayTapSettings, maxTaps>& taps, int numTaps,
+        float delayInSamples, float minDelayInSamples, int startSample, int numSamples)
+    {
+        auto* destination = tapBuffer.getWritePointer(channel, startSample);
+        juce::FloatVectorOperations::clear(destination, numSamples);
+
+        auto maxDelayInSamples = line.getMaxDelayInSamples();
+
+        for (int tap = 0; tap < numTaps; ++tap) {
+            auto& settings = taps[(size_t)tap];
+            auto gain = settings.gain;
+
+            if (numChannels > 1) {
+                auto angle = (settings.pan + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+                gain *= (channel == 0) ? std::cos(angle) : std::sin(angle);
+            }
+
+            if (gain == 0.0f)
+                continue;
+
+            auto tapDelay = juce::jlimit(minDelayInSamples, juce::jmax(minDelayInSamples, maxDelayInSamples), settings.time * delayInSamples);
+            int wholeDelay = (int)ceilf(tapDelay);
+            float fraction = (float)wholeDelay - tapDelay;
+            float fractionSqrt = fraction * fraction;
+            float fractionCube = fractionSqrt * fraction;
+
+            const float coefficients[] =
+            {
+                gain * (-0.5f * fractionCube + fractionSqrt - 0.5f * fraction),
+                gain * (1.5f * fractionCube - 2.5f * fractionSqrt + 1.0f),
+                gain * (-1.5f * fractionCube + 2.0f * fractionSqrt + 0.5f * fraction),
+                gain * (0.5f * fractionCube - 0.5f * fractionSqrt)
+            };
+
+            for (int offset = 0; offset < numSamples; offset += windowChunk) {
+                int num = juce::jmin(windowChunk, numSamples - offset);
+
+                line.readBlock(channel, line.writePosition + offset - wholeDelay - 1, window.data(), num + 3);
+
+                kernels->addFir4(destination + offset, window.data(), coefficients, num);
+            }
+        }
+    }
+
+private:
+    const SimdKernels* kernels = &getSimdKernels(SimdBaseline);
+    std::array<float, windowChunk + 3> window{};
+};
+
+enum DelayMode
+{
+    Clean,
+    Granular
+};
+
+struct GrainSettings
+{
+    float pitch{ 12.0f }, size{ 0.12f }, spray{ 0.02f };   // semitones, seconds, seconds
+    int density{ 4 };                                       // grains sounding at once
+};
+
+// Granular repeats: overlapping Hann-windowed grains read out of the delay line
+// at a shifted pitch, starting around the delay time plus a random spray. Grains
+// live in a fixed pool kept as structure-of-arrays, so a dense cloud costs at most
+// maxGrains grains per tile and never allocates. Like the taps, every grain reads
+// far enough behind the write head for a whole tile to be rendered up front.
+struct GrainCloud
+{
+    static constexpr int maxGrains = 128;
+    static constexpr int batchSize = 8;
+    static constexpr int windowSize = 1024;
+    static constexpr float maxPitch = 24.0f;
+    static constexpr float maxRatio = 4.0f;
+
+    juce::AudioBuffer<float> grainBuffer;
+
+    GrainCloud()
+    {
+        for (int i = 0; i <= windowSize; ++i) {
+            window[(size_t)i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float)i / (float)windowSize);
+        }
+    }
+
+    void prepare(int numChannels, int maxTileSize, double newSampleRate, const SimdKernels& simdKernels)
+    {
+        sampleRate = (float)newSampleRate;
+        tileSize = maxTileSize;
+        kernels = &simdKernels;
+
+        grainBuffer.setSize(numChannels, tileSize);
+        grainBuffer.clear();
+        envelopes.assign((size_t)(maxGrains * tileSize), 0.0f);
+        voices.assign((size_t)(batchSize * tileSize), 0.0f);
+        mixed.assign((size_t)tileSize, 0.0f);
+        span.assign((size_t)(maxRatio * (float)tileSize) + 4, 0.0f);
+
+        reset();
+    }
+
+    // Fixed seed, so offline bounces of the same session come out identical
+    void reset()
+    {
+        numActive = 0;
+        samplesToNextGrain = 0.0f;
+        random.setSeed(0x4d444c59);
+    }
+
+    int getNumActive() const { return numActive; }
+
+    // The farthest behind the write head grains started with these settings read,
+    // before beginTile fits them under its maxDistance
+    float getReach(const GrainSettings& settings, float delayInSamples, float minDistance) const
+    {
+        auto drift = getDrift(settings);
+        auto start = juce::jmax(delayInSamples, minDistance + juce::jmax(0.0f, -drift));
+
+        return start + settings.spray * sampleRate + std::abs(drift);
+    }
+
+    // Starts the grains whose onsets fall in this tile and works out every active
+    // grain's window for it. Reads stay between minDistance and maxDistance
+    // samples behind the write head for the whole life of a grain.
+    void beginTile(const GrainSettings& settings, float delayInSamples, float minDistance, float maxDistance, int numSamples)
+    {
+        jassert(numSamples <= tileSize);
+
+        auto ratio = getRatio(settings);
+        auto length = getLength(settings);
+        auto density = juce::jlimit(1, maxGrains, settings.density);
+        auto spray = settings.spray * sampleRate;
+        auto drift = getDrift(settings);
+        auto earliest = minDistance + juce::jmax(0.0f, -drift);
+        auto latest = juce::jmax(earliest, maxDistance - juce::jmax(0.0f, drift) - spray);
+        auto start = juce::jlimit(earliest, latest, delayInSamples);
+
+        // A full pool skips onsets rather than growing
+        for (; samplesToNextGrain < (float)numSamples; samplesToNextGrain += length / (float)density) {
+            if (numActive == maxGrains)
+                continue;
+
+            auto grain = numActive++;
+            auto onset = samplesToNextGrain;
+
+            ratios[(size_t)grain] = ratio;
+            phaseIncrements[(size_t)grain] = (float)windowSize / length;
+            phases[(size_t)grain] = -onset * phaseIncrements[(size_t)grain];
+            distances[(size_t)grain] = start + random.nextFloat() * spray - onset * (1.0f - ratio);
+        }
+
+        samplesToNextGrain -= (float)numSamples;
+
+        // Overlapping grains are mostly uncorrelated, so they add up in power
+        gain = juce::jmin(1.0f, 1.0f / std::sqrt(0.375f * (float)density));
+
+        for (int grain = 0; grain < numActive; ++grain) {
+            auto* envelope = envelopes.data() + grain * tileSize;
+
+            for (int sample = 0; sample < numSamples; ++sample) {
+                auto phase = phases[(size_t)grain] + (float)sample * phaseIncrements[(size_t)grain];
+
+                if (phase < 0.0f || phase >= (float)windowSize) {
+                    envelope[sample] = 0.0f;
+                    continue;
+                }
+
+                auto index = (int)phase;
+                auto fraction = phase - (float)index;
+                envelope[sample] = window[(size_t)index] + fraction * (window[(size_t)index + 1] - window[(size_t)index]);
+            }
+        }
+    }
+
+    // Renders one channel of the tile into grainBuffer. Grains are mixed a batch at a
+    // time: their reads are gathered into one block per batch, then windowed and summed
+    // with vector operations, and the batch joins the channel in one kernel pass.
+    void render(const DelayLineEffect& line, int channel, int numSamples)
+    {
+        auto* destination = grainBuffer.getWritePointer(channel);
+        juce::FloatVectorOperations::clear(destination, numSamples);
+
+        for (int first = 0; first < numActive; first += batchSize) {
+            auto numInBatch = juce::jmin(batchSize, numActive - first);
+
+            for (int lane = 0; lane < numInBatch; ++lane) {
+                auto grain = (size_t)(first + lane);
+                auto* voice = voices.data() + lane * tileSize;
+
+                // Whole and fractional distance apart, as in DelayLineEffect::process
+                int wholeDistance = (int)std::ceil(distances[grain]);
+                float fraction = (float)wholeDistance - distances[grain];
+                int numRead = (int)(fraction + (float)(numSamples - 1) * ratios[grain]) + 2;
+
+                line.readBlock(channel, line.writePosition - wholeDistance, span.data(), numRead);
+
+                for (int sample = 0; sample < numSamples; ++sample) {
+                    auto position = fraction + (float)sample * ratios[grain];
+                    auto index = (int)position;
+                    auto weight = position - (float)index;
+                    voice[sample] = span[(size_t)index] + weight * (span[(size_t)index + 1] - span[(size_t)index]);
+                }
+            }
+
+            juce::FloatVectorOperations::clear(mixed.data(), numSamples);
+
+            for (int lane = 0; lane < numInBatch; ++lane) {
+                juce::FloatVectorOperations::addWithMultiply(mixed.data(), voices.data() + lane * tileSize,
+                    envelopes.data() + (first + lane) * tileSize, numSamples);
+            }
+
+            kernels->addWithMultiply(destination, mixed.data(), gain, numSamples);
+        }
+    }
+
+    // After every channel has rendered the tile: moves the grains on and retires finished ones
+    void endTile(int numSamples)
+    {
+        for (int grain = 0; grain < numActive; ++grain) {
+            distances[(size_t)grain] += (float)numSamples * (1.0f - ratios[(size_t)grain]);
+            phases[(size_t)grain] += (float)numSamples * phaseIncrements[(size_t)grain];
+        }
+
+        for (int grain = numActive - 1; grain >= 0; --grain) {
+            if (phases[(size_t)grain] < (float)windowSize)
+                continue;
+
+            auto last = (size_t)--numActive;
+            distances[(size_t)grain] = distances[last];
+            phases[(size_t)grain] = phases[last];
+            phaseIncrements[(size_t)grain] = phaseIncrements[last];
+            ratios[(size_t)grain] = ratios[last];
+        }
+    }
+
+private:
+    static float getRatio(const GrainSettings& settings)
+    {
+        return std::pow(2.0f, juce::jlimit(-maxPitch, maxPitch, settings.pitch) / 12.0f);
+    }
+
+    float getLength(const GrainSettings& settings) const
+    {
+        return juce::jmax(1.0f, settings.size * sampleRate);
+    }
+
+    // Shifting up, a grain's reads catch up with the write head; shifting down, they fall behind
+    float getDrift(const GrainSettings& settings) const
+    {
+        return (1.0f - getRatio(settings)) * getLength(settings);
+    }
+
+    const SimdKernels* kernels = &getSimdKernels(SimdBaseline);
+    float sampleRate = 44100.0f;
+    int tileSize = 0;
+
+    // The pool; the first numActive entries are sounding
+    std::array<float, maxGrains> distances{};
+    std::array<float, maxGrains> phases{};
+    std::array<float, maxGrains> phaseIncrements{};
+    std::array<float, maxGrains> ratios{};
+    int numActive = 0;
+    float samplesToNextGrain = 0.0f;
+    float gain = 1.0f;
+    juce::Random random;
+
+    std::array<float, windowSize + 1> window{};
+    std::vector<float> envelopes;
+    std::vector<float> voices;
+    std::vector<float> mixed;
+    std::vector<float> span;
+};
+
+const juce::String& getTapParameterID(int tap, TapParameter parameter);
+
+enum FeedbackMode
+{
+    Stereo,
+    CrossFeed,
+    PingPong
+};
+
+struct FeedbackMatrix
+{
+    static constexpr int maxChannels = 2;
+    using Gains = std::array<std::array<float, maxChannels>, maxChannels>;
+
+    // Row = delay line written to, column = source channel
+    Gains inputGains{};
+    Gains feedbackGains{};
+
+    void setMode(FeedbackMode newMode, float newCrossFeed, float newFeedback)
+    {
+        if (newMode == mode && newCrossFeed == crossFeed && newFeedback == feedback)
+            return;
+
+        mode = newMode;
+        crossFeed = newCrossFeed;
+        feedback = newFeedback;
+
+        switch (mode) {
+            case PingPong:
+                // Mono sum enters the left line only and the repeats swap sides
+                inputGains = { { { 0.5f, 0.5f }, { 0.0f, 0.0f } } };
+                feedbackGains = { { { 0.0f, feedback }, { feedback, 0.0f } } };
+                break;
+            case CrossFeed:
+                inputGains = { { { 1.0f, 0.0f }, { 0.0f, 1.0f } } };
+                feedbackGains = { { { feedback * (1.0f - crossFeed), feedback * crossFeed },
+                    { feedback * crossFeed, feedback * (1.0f - crossFeed) } } };
+                break;
+            default:
+                inputGains = { { { 1.0f, 0.0f }, { 0.0f, 1.0f } } };
+                feedbackGains = { { { feedback, 0.0f }, { 0.0f, feedback } } };
+                break;
+        }
+    }
+
+    // Builds the delay line inputs for a whole block: vectorised along the block,
+    // one multiply-add per non-zero matrix entry. Destinations must not alias the sources.
+    void process(const float* const* inputs, const float* const* delayed, float* const* destinations,
+        int numChannels, int numSamples, const SimdKernels& kernels) const
+    {
+        for (int row = 0; row < numChannels; ++row) {
+            auto* destination = destinations[row];
+            juce::FloatVectorOperations::clear(destination, numSamples);
+
+            for (int column = 0; column < numChannels; ++column) {
+                auto inputGain = inputGains[(size_t)row][(size_t)column];
+                auto feedbackGain = feedbackGains[(size_t)row][(size_t)column];
+
+                if (inputGain != 0.0f)
+                    kernels.addWithMultiply(destination, inputs[column], inputGain, numSamples);
+                if (feedbackGain != 0.0f)
+                    kernels.addWithMultiply(destination, delayed[column], feedbackGain, numSamples);
+            }
+        }
+    }
+
+private:
+    FeedbackMode mode = Stereo;
+    float crossFeed = -1.0f;
+    float feedback = -1.0f;
+};
+
+enum ReverbType
+{
+    Algorithmic,
+    Convolution
+};
+
 enum NumOfVoices
 {
     Two,
@@ -159,11 +848,55 @@ struct ChainSettings
         damping{ 0.8f }, revWidth{ 0.5f };
     bool flangerOn{ true }, vibratoOn{ true }, chorusOn{ true },
         dryReverbOn{ true }, wetReverbOn{ true };
+    int tapCount{ 0 };
+    std::array<DelayTapSettings, MultiTapDelay::maxTaps> taps;
+    FeedbackMode feedbackMode{ FeedbackMode::Stereo };
+    float crossFeed{ 0.5f };
+    FeedbackFilterSettings feedbackFilter;
+    std::array<int, NumRoutedEffects> effectStages{ { 1, 2, 3, 4 } };
+    ReverbType reverbType{ ReverbType::Algorithmic };
+    DelayMode delayMode{ DelayMode::Clean };
+    GrainSettings grains;
 };
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts);
 
-class MastersDelayAudioProcessor  : public juce::AudioProcessor
+enum QualityTier
+{
+    QualityLive,
+    QualityOffline,
+    NumQualityTiers
+};
+
+// Where the CPU goes. Live playback runs one profile and offline bounces the
+// other; both are parameters of their own, which programs leave alone.
+struct QualityProfile
+{
+    InterpolationQuality interpolation{ InterpolationCubic };
+    int lfoInterval{ 1 };
+    int maxReverbStages{ MultiRateReverb::maxStages };
+};
+
+QualityProfile getQualityProfile(juce::AudioProcessorValueTreeState& apvts, QualityTier tier);
+RoutingSpec getRoutingSpec(const ChainSettings& settings);
+RoutingSpec getStageAssignment(const ChainSettings& settings);
+juce::uint32 getBypassMask(const ChainSettings& settings);
+
+// What the engine was running when a block came close to its deadline
+struct EngineSnapshot
+{
+    ChainSettings settings;
+    juce::uint32 routingKey = 0;
+    SimdLevel simdLevel = SimdBaseline;
+    bool programFading = false;
+    bool dualMono = false;
+    int governorLevel = GovernorFullQuality;
+    bool pipelined = false;
+    int activeGrains = 0;
+};
+
+class MastersDelayAudioProcessor  : public juce::AudioProcessor,
+                                    private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -210,26 +943,176 @@ public:
     juce::AudioProcessorValueTreeState apvts{ *this, nullptr, "Parameters", createParameterLayout() };
 
     void turnOnFlangerAndEffects();
+
+    // Message thread. The impulse response is used by both reverb sends while
+    // "Reverb Type" is set to Convolution.
+    bool loadImpulseResponse(const juce::File& file);
+    void clearImpulseResponse();
+    juce::File getImpulseResponseFile() const;
     void setDelayTimeFromTapTempo(float delayTime);
 
+    // MIDI controllers that drive the delay time and the tap tempo
+    static constexpr int delayTimeController = 12;
+    static constexpr int tapTempoController = 13;
+
+    static constexpr float maxDelayTime = 60.0f;
+
+    // Reported as tail after the last repeat. Impulse responses are cut to this
+    // length, and the algorithmic reverb dies away well within it.
+    static constexpr double reverbTailSeconds = 10.0;
+
+    // Written by the audio thread, read by the editor's timer
+    Metering metering;
+    SpectrumAnalyser spectrumAnalyser;
+    DeadlineMonitor<EngineSnapshot> deadlines;
+    LoadGovernor governor;
+
+    // Message thread only, the worst-block list's single reader: the worst
+    // blocks so far, and a readable dump of them
+    const DeadlineMonitor<EngineSnapshot>::WorstBlocks& getWorstBlocks();
+    juce::String createDeadlineReport();
+    void logDeadlineReport();
 
 private:
 
+    void timerCallback() override;
+
+    void prepareScratchBuffers();
+    void processEngineBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    void processSubBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+    bool canRunDualMono(const ChainSettings& settings) const;
+    void duplicateProcessedChannel(juce::AudioBuffer<float>& target, int startSample, int numSamples);
+    void expandDualMono(int startSample, int numSamples);
+    void runRouting(const RoutingProgram& routing, const ChainSettings& settings, int startSample, int numSamples);
+    void processRoutedEffect(RoutedEffect effect, juce::AudioBuffer<float>& target,
+        const ChainSettings& settings, int startSample, int numSamples);
+    void publishRouting(juce::uint32 stagesKey);
+    bool buildConvolution(const juce::File& file, double sampleRate, bool immediately);
+    bool processConvolution(ConvolutionReverb& reverb, juce::AudioBuffer<float>& target,
+        const juce::Reverb::Parameters& parameters, const ChainSettings& settings, int startSample, int numSamples);
+    ChainSettings getEngineSettings();
+    void mixProgramFade(juce::AudioBuffer<float>& buffer, int startSample, int numSamples, float dryLevel, float wetLevel);
+    void applyProgramToParameters(const ChainSettings& settings);
+    void handleMidiMessage(const juce::MidiMessage& message, juce::int64 timeInSamples);
+    void registerTap(double timeInSeconds);
+    void applyPendingDelayTime();
+
+    // Parameters are re-read on a fixed grid of absolute sample positions,
+    // so automation lands on the same samples whatever the host buffer size.
+    // It is also the largest tile the engine and its scratch buffers work in.
+    static constexpr int parameterUpdateInterval = 32;
+    static constexpr int maxTapCount = 4;
+
+    // A longer pause between taps starts a new tap sequence
+    static constexpr double tapTimeout = 2.5;
+    juce::int64 samplePosition = 0;
+
+    // Program changes reach the audio thread as a pointer to a precomputed
+    // snapshot. The engine's output fades out on the old settings, switches, and
+    // fades in on the snapshot, which it keeps using until the parameters have
+    // caught up. The dry signal is not faded.
+    enum class ProgramFade
+    {
+        None,
+        FadingOut,
+        FadingIn
+    };
+
+    int currentProgram = 0;
+    std::atomic<const ChainSettings*> pendingProgram{ nullptr };
+    std::atomic<bool> programParametersSynced{ true };
+    const ChainSettings* incomingProgram = nullptr;
+    const ChainSettings* programOverride = nullptr;
+    ChainSettings lastSettings;
+    ProgramFade programFade = ProgramFade::None;
+    int programFadePosition = 0;
+    int programFadeLength = parameterUpdateInterval;
+    float programFadeDryLevel = 0.0f;   // the old program's, for the glide
+
     DelayLineEffect delay;
     DelayLineEffect flanger;
     DelayLineEffect vibrato;
     DelayLineEffect chorus;
 
-    juce::Reverb dryReverb;
+    MultiRateReverb dryReverb;
     juce::Reverb::Parameters dryRevParams;
     juce::AudioBuffer<float> dryRevBufferCopy;
 
-    juce::Reverb wetReverb;
+    MultiRateReverb wetReverb;
     juce::Reverb::Parameters wetRevParams;
     juce::AudioBuffer<float> wetRevBufferCopy;
 
+    // Rate the sample rate asks for; the quality profile can cap it
+    int automaticReverbStages = 0;
+
+    // Built on the message thread, swapped in by the audio thread
+    ConvolutionReverb dryConvolution;
+    ConvolutionReverb wetConvolution;
+    juce::File impulseResponseFile;
+    juce::CriticalSection impulseResponseLock;
+
+    // What the newest engines were built for; prepareToPlay only rebuilds when this changes
+    juce::File builtImpulseResponseFile;
+    double builtImpulseResponseRate = 0.0;
+    int builtImpulseResponseChannels = 0;
+
+    // Set by releaseResources; the timer, or the destructor if it comes first, writes the report
+    std::atomic<bool> deadlineReportPending{ false };
+
+    // Chosen in prepareToPlay for this CPU
+    const SimdKernels* kernels = &getSimdKernels(SimdBaseline);
+
+    MultiTapDelay multiTap;
+
+    // Granular repeats take over from the clean ones over granularFadeSamples
+    static constexpr int granularFadeSamples = 512;
+    GrainCloud grainCloud;
+    float granularMix = 0.0f;
+    FeedbackMatrix feedbackMatrix;
+    FeedbackFilter feedbackFilter;
+    juce::AudioBuffer<float> feedbackBuffer;
+    juce::AudioBuffer<float> delayInputBuffer;
+
+    // Compiled on the message thread, picked up by the audio thread through the triple buffer.
+    // The keys are stage assignments; bypass picks the program within the set.
+    TripleBuffer<RoutingSet> routings;
+    std::atomic<juce::uint32> requestedRouting{ 0 };
+    juce::uint32 compiledRouting = 0;
+    const RoutingSet* activeRoutings = nullptr;
+    const RoutingProgram* activeRouting = nullptr;
+    RoutingProgram offlineRouting;
+    juce::AudioBuffer<float> stageInputBuffer;
+    juce::AudioBuffer<float> branchBuffer;
+
+    juce::AudioBuffer<float> delayOutBuffer;
+    juce::AudioBuffer<float> modOutBuffer;
+
+    // Dual-mono fast path: once both inputs have been bit-identical for dualMonoHoldSamples,
+    // sub-blocks that nothing makes stereo run channel 0 alone and copy it. The first
+    // block whose inputs differ switches back, and the channel states never drift apart.
+    static constexpr int dualMonoHoldSamples = 4096;
+    int dualMonoSamples = 0;
+    bool inputIsDualMono = false;
+    bool ranDualMono = false;
+    int processedChannels = 0;
+    bool dryReverbActive = false;
+    bool wetReverbActive = false;
+
     std::vector<double> tapTimes;
     std::vector<int> durationVec;
+
+    // Delay time asked for by MIDI, normalised; negative when nothing is pending. The
+    // engine may run on the pipeline's worker, so the host callback tells the host.
+    juce::RangedAudioParameter* delayTimeParameter = apvts.getParameter("Delay Time");
+    std::atomic<float> pendingDelayTime{ -1.0f };
+
+    // "Pipelined" as of the last prepareToPlay: the engine runs one block behind on the
+    // pipeline's worker and the latency says so. Declared last, so the worker stops
+    // before anything it renders with is destroyed.
+    bool pipelined = false;
+    int pipelineLatency = 0;
+    std::atomic<bool> pipelineRestartRequested{ false };
+    BlockPipeline pipeline{ [this](juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi) { processEngineBlock(buffer, midi); } };
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MastersDelayAudioProcessor)
 };
\ No newline at end of file
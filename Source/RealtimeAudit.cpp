@@ -0,0 +1,408 @@
+/*
+  ==============================================================================
+
+    Hooks behind the real-time safety audit.
+
+    Windows debug CRT: the allocation hook sees malloc, realloc and free.
+    Linux (glibc): malloc and friends, operator new and delete and the
+    blocking calls are defined here with hidden visibility. The linker then
+    binds every call made from inside the plugin to them, including from the
+    statically linked JUCE code, even when the host dlopens the plugin with
+    RTLD_LOCAL and its own malloc comes first in the global scope. Nothing
+    is exported, so the host and other libraries keep their allocator; the
+    hooks forward to whatever the process resolves. Allocations made inside
+    other shared libraries (libstdc++ internals) are not seen.
+    Elsewhere only operator new and delete are replaced.
+
+    The audio thread only captures the raw stack frames into a lock-free
+    queue; the message thread symbolises and logs them.
+
+  ==============================================================================
+*/
+
+#include "RealtimeAudit.h"
+
+#if MASTERSDELAY_RT_AUDIT
+
+#include <array>
+#include <atomic>
+#include <new>
+
+#if JUCE_WINDOWS
+ #include <crtdbg.h>
+ #include <windows.h>
+ #include <dbghelp.h>
+ #pragma comment (lib, "DbgHelp.lib")
+#else
+ #include <execinfo.h>
+#endif
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <time.h>
+ #include <unistd.h>
+#endif
+
+#if JUCE_LINUX
+ // Initial-exec TLS never allocates on first access, so it is safe to touch inside malloc
+ #define MASTERSDELAY_AUDIT_TLS thread_local __attribute__((tls_model("initial-exec")))
+#else
+ #define MASTERSDELAY_AUDIT_TLS thread_local
+#endif
+
+#if JUCE_WINDOWS && defined (_DEBUG)
+ #define MASTERSDELAY_AUDIT_CRT_HOOK 1
+#else
+ #define MASTERSDELAY_AUDIT_CRT_HOOK 0
+#endif
+
+namespace RealtimeAudit
+{
+    namespace
+    {
+        MASTERSDELAY_AUDIT_TLS int auditDepth = 0;
+        MASTERSDELAY_AUDIT_TLS bool reporting = false;
+
+        std::atomic<int> violationCount{ 0 };
+        std::atomic<int> droppedViolations{ 0 };
+
+        // Later violations are only counted, so a bad block cannot flood the log
+        constexpr int maxLoggedViolations = 32;
+        constexpr int maxFrames = 24;
+
+        struct Violation
+        {
+            const char* what;
+            int numFrames;
+            std::array<void*, maxFrames> frames;
+        };
+
+        // Several audio threads may report at once. The lock is only ever
+        // tried: a busy queue drops the violation instead of waiting.
+        std::array<Violation, maxLoggedViolations> queue;
+        int numQueued = 0;
+        std::atomic_flag queueLock = ATOMIC_FLAG_INIT;
+
+        int captureFrames(std::array<void*, maxFrames>& frames)
+        {
+           #if JUCE_WINDOWS
+            return (int)CaptureStackBackTrace(0, (DWORD)maxFrames, frames.data(), nullptr);
+           #else
+            return backtrace(frames.data(), maxFrames);
+           #endif
+        }
+
+        juce::String describeFrames(const Violation& violation)
+        {
+            juce::String text;
+
+           #if JUCE_WINDOWS
+            auto process = GetCurrentProcess();
+            static const bool symbolsLoaded = SymInitialize(process, nullptr, TRUE) != FALSE;
+
+            for (int frame = 0; frame < violation.numFrames; ++frame) {
+                alignas(SYMBOL_INFO) char symbolBuffer[sizeof(SYMBOL_INFO) + 256] = {};
+                auto* symbol = reinterpret_cast<SYMBOL_INFO*>(symbolBuffer);
+                symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+                symbol->MaxNameLen = 255;
+
+                text << frame << ": ";
+
+                if (symbolsLoaded && SymFromAddr(process, (DWORD64)violation.frames[(size_t)frame], nullptr, symbol))
+                    text << symbol->Name;
+                else
+                    text << juce::String::toHexString((juce::pointer_sized_int)violation.frames[(size_t)frame]);
+
+                text << juce::newLine;
+            }
+           #else
+            if (auto** symbols = backtrace_symbols(violation.frames.data(), violation.numFrames)) {
+                for (int frame = 0; frame < violation.numFrames; ++frame) {
+                    text << frame << ": " << symbols[frame] << juce::newLine;
+                }
+
+                ::free(symbols);
+            }
+           #endif
+
+            return text;
+        }
+
+       #if MASTERSDELAY_AUDIT_CRT_HOOK
+        int allocationHook(int allocType, void*, size_t, int blockType, long, const unsigned char*, int)
+        {
+            if (blockType != _CRT_BLOCK) {
+                reportViolation(allocType == _HOOK_FREE ? "free" : (allocType == _HOOK_REALLOC ? "realloc" : "malloc"));
+            }
+
+            return TRUE;
+        }
+       #endif
+
+        void installHooks()
+        {
+           #if MASTERSDELAY_AUDIT_CRT_HOOK
+            static const bool installed = []
+                {
+                    _CrtSetAllocHook(allocationHook);
+                    return true;
+                }();
+
+            juce::ignoreUnused(installed);
+           #endif
+        }
+    }
+
+    ScopedAudioThread::ScopedAudioThread()
+    {
+        installHooks();
+        ++auditDepth;
+    }
+
+    ScopedAudioThread::~ScopedAudioThread()
+    {
+        --auditDepth;
+    }
+
+    ScopedExemption::ScopedExemption()
+        : savedDepth(auditDepth)
+    {
+        auditDepth = 0;
+    }
+
+    ScopedExemption::~ScopedExemption()
+    {
+        auditDepth = savedDepth;
+    }
+
+    void reportViolation(const char* what)
+    {
+        if (auditDepth == 0 || reporting)
+            return;
+
+        // The first stack capture may allocate too; the flag keeps the hooks quiet meanwhile
+        reporting = true;
+
+        if (++violationCount <= maxLoggedViolations) {
+            Violation violation;
+            violation.what = what;
+            violation.numFrames = captureFrames(violation.frames);
+
+            if (!queueLock.test_and_set(std::memory_order_acquire)) {
+                if (numQueued < maxLoggedViolations)
+                    queue[(size_t)numQueued++] = violation;
+                else
+                    ++droppedViolations;
+
+                queueLock.clear(std::memory_order_release);
+            }
+            else {
+                ++droppedViolations;
+            }
+        }
+
+        reporting = false;
+    }
+
+    void logViolations()
+    {
+        std::array<Violation, maxLoggedViolations> pending;
+        int numPending = 0;
+
+        // An audio thread holds the queue for a few copies at most; try again next time
+        if (queueLock.test_and_set(std::memory_order_acquire))
+            return;
+
+        numPending = numQueued;
+        std::copy_n(queue.begin(), numPending, pending.begin());
+        numQueued = 0;
+
+        queueLock.clear(std::memory_order_release);
+
+        for (int i = 0; i < numPending; ++i) {
+            juce::Logger::writeToLog(juce::String("Real-time violation on the audio thread: ") + pending[(size_t)i].what
+                + juce::newLine + describeFrames(pending[(size_t)i]));
+        }
+
+        if (auto numDropped = droppedViolations.exchange(0))
+            juce::Logger::writeToLog(juce::String(numDropped) + " real-time violations dropped while the log queue was busy");
+    }
+
+    int getViolationCount()
+    {
+        return violationCount.load();
+    }
+
+    void resetViolationCount()
+    {
+        violationCount.store(0);
+    }
+}
+
+#if JUCE_LINUX
+//==============================================================================
+namespace
+{
+    // The hooks are hidden, so the process-wide lookup finds the next definition
+    // (the host's allocator or glibc) and never the hook itself
+    template <typename Function>
+    Function getProcessFunction(std::atomic<void*>& cache, const char* name)
+    {
+        auto* function = cache.load(std::memory_order_relaxed);
+
+        if (function == nullptr) {
+            function = dlsym(RTLD_DEFAULT, name);
+            cache.store(function, std::memory_order_relaxed);
+        }
+
+        return reinterpret_cast<Function>(function);
+    }
+
+    std::atomic<void*> processMalloc{ nullptr };
+    std::atomic<void*> processCalloc{ nullptr };
+    std::atomic<void*> processRealloc{ nullptr };
+    std::atomic<void*> processFree{ nullptr };
+    std::atomic<void*> processMutexLock{ nullptr };
+    std::atomic<void*> processCondWait{ nullptr };
+    std::atomic<void*> processNanosleep{ nullptr };
+    std::atomic<void*> processUsleep{ nullptr };
+}
+
+// The C declarations in the system headers win over a visibility attribute,
+// so the symbols are hidden at the assembler level instead
+#if __SIZEOF_SIZE_T__ == __SIZEOF_LONG__
+ #define MASTERSDELAY_SIZE_T_MANGLING "m"
+#else
+ #define MASTERSDELAY_SIZE_T_MANGLING "j"
+#endif
+
+__asm__(".hidden malloc");
+__asm__(".hidden calloc");
+__asm__(".hidden realloc");
+__asm__(".hidden free");
+__asm__(".hidden pthread_mutex_lock");
+__asm__(".hidden pthread_cond_wait");
+__asm__(".hidden nanosleep");
+__asm__(".hidden usleep");
+__asm__(".hidden _Znw" MASTERSDELAY_SIZE_T_MANGLING);
+__asm__(".hidden _Zna" MASTERSDELAY_SIZE_T_MANGLING);
+__asm__(".hidden _ZdlPv");
+__asm__(".hidden _ZdaPv");
+__asm__(".hidden _ZdlPv" MASTERSDELAY_SIZE_T_MANGLING);
+__asm__(".hidden _ZdaPv" MASTERSDELAY_SIZE_T_MANGLING);
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        RealtimeAudit::reportViolation("malloc");
+        return getProcessFunction<void* (*)(size_t)>(processMalloc, "malloc")(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        RealtimeAudit::reportViolation("calloc");
+        return getProcessFunction<void* (*)(size_t, size_t)>(processCalloc, "calloc")(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        RealtimeAudit::reportViolation("realloc");
+        return getProcessFunction<void* (*)(void*, size_t)>(processRealloc, "realloc")(pointer, size);
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            RealtimeAudit::reportViolation("free");
+
+        getProcessFunction<void (*)(void*)>(processFree, "free")(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        RealtimeAudit::reportViolation("pthread_mutex_lock");
+        return getProcessFunction<int (*)(pthread_mutex_t*)>(processMutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        RealtimeAudit::reportViolation("pthread_cond_wait");
+        return getProcessFunction<int (*)(pthread_cond_t*, pthread_mutex_t*)>(processCondWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        RealtimeAudit::reportViolation("nanosleep");
+        return getProcessFunction<int (*)(const struct timespec*, struct timespec*)>(processNanosleep, "nanosleep")(duration, remaining);
+    }
+
+    int usleep(useconds_t microseconds)
+    {
+        RealtimeAudit::reportViolation("usleep");
+        return getProcessFunction<int (*)(useconds_t)>(processUsleep, "usleep")(microseconds);
+    }
+}
+#endif
+
+#if JUCE_LINUX || ! MASTERSDELAY_AUDIT_CRT_HOOK
+//==============================================================================
+// On Linux these only report through malloc and free, so the libstdc++
+// operators cannot bypass the hooks above
+void* operator new(size_t size)
+{
+   #if ! JUCE_LINUX
+    RealtimeAudit::reportViolation("operator new");
+   #endif
+
+    if (auto* pointer = std::malloc(size))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+   #if ! JUCE_LINUX
+    RealtimeAudit::reportViolation("operator new[]");
+   #endif
+
+    if (auto* pointer = std::malloc(size))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+   #if ! JUCE_LINUX
+    if (pointer != nullptr)
+        RealtimeAudit::reportViolation("operator delete");
+   #endif
+
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+   #if ! JUCE_LINUX
+    if (pointer != nullptr)
+        RealtimeAudit::reportViolation("operator delete[]");
+   #endif
+
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    operator delete[](pointer);
+}
+#endif
+
+#endif
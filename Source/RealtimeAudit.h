@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    Real-time safety audit. While a ScopedAudioThread is alive on a thread,
+    heap allocations, mutex locks and sleeping system calls made from that
+    thread are reported with a stack trace. The audio thread only queues
+    them; logViolations writes them to the log from the message thread.
+
+    On by default in debug builds. Define MASTERSDELAY_RT_AUDIT=1 to audit a
+    release build (benchmarks), or 0 to switch it off.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef MASTERSDELAY_RT_AUDIT
+ #define MASTERSDELAY_RT_AUDIT JUCE_DEBUG
+#endif
+
+namespace RealtimeAudit
+{
+   #if MASTERSDELAY_RT_AUDIT
+    struct ScopedAudioThread
+    {
+        ScopedAudioThread();
+        ~ScopedAudioThread();
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedAudioThread)
+    };
+
+    // Suspends the audit for a call known to lock only briefly, such as
+    // waking a worker with juce::Thread::notify
+    struct ScopedExemption
+    {
+        ScopedExemption();
+        ~ScopedExemption();
+
+    private:
+        int savedDepth;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedExemption)
+    };
+
+    // Called by the hooks; does nothing outside an audited scope
+    void reportViolation(const char* what);
+
+    // Message thread: logs the violations queued since the last call
+    void logViolations();
+
+    // For test harnesses: violations seen since the last reset
+    int getViolationCount();
+    void resetViolationCount();
+   #else
+    struct ScopedAudioThread
+    {
+        ScopedAudioThread() {}
+    };
+
+    struct ScopedExemption
+    {
+        ScopedExemption() {}
+    };
+
+    inline void reportViolation(const char*) {}
+    inline void logViolations() {}
+    inline int getViolationCount() { return 0; }
+    inline void resetViolationCount() {}
+   #endif
+}
\ No newline at end of file
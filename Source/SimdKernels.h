@@ -0,0 +1,373 @@
+/*
+  ==============================================================================
+
+    Block kernels built for several instruction sets in the same binary.
+    Each variant is compiled for its own ISA through per-function target
+    attributes, and prepareToPlay picks the widest one this CPU supports.
+    Setting MASTERSDELAY_SIMD (baseline, sse2, avx2, avx512) in the
+    environment caps the choice for testing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+
+ #if JUCE_MSVC
+  #define MASTERSDELAY_TARGET(isa)
+ #else
+  #define MASTERSDELAY_TARGET(isa) __attribute__((target(isa)))
+ #endif
+#endif
+
+enum SimdLevel
+{
+    SimdBaseline,
+    SimdSSE2,
+    SimdAVX2,
+    SimdAVX512,
+    NumSimdLevels
+};
+
+struct SimdKernels
+{
+    SimdLevel level;
+    const char* name;
+
+    // out = dry * dryGain + wet * wetGain
+    void (*mix)(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples);
+
+    // destination += source * gain
+    void (*addWithMultiply)(float* destination, const float* source, float gain, int numSamples);
+
+    // destination[i] += sum of coefficients[k] * source[i + k] for k < 4,
+    // source holds numSamples + 3 values
+    void (*addFir4)(float* destination, const float* source, const float* coefficients, int numSamples);
+
+    // The same over six coefficients, source holds numSamples + 5 values
+    void (*addFir6)(float* destination, const float* source, const float* coefficients, int numSamples);
+};
+
+namespace SimdKernelVariants
+{
+    //==============================================================================
+    // Baseline: whatever JUCE's vector operations were built for (SSE or NEON)
+
+    inline void mixBaseline(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples)
+    {
+        juce::FloatVectorOperations::multiply(out, dry, dryGain, numSamples);
+        juce::FloatVectorOperations::addWithMultiply(out, wet, wetGain, numSamples);
+    }
+
+    inline void addWithMultiplyBaseline(float* destination, const float* source, float gain, int numSamples)
+    {
+        juce::FloatVectorOperations::addWithMultiply(destination, source, gain, numSamples);
+    }
+
+    inline void addFir4Baseline(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        for (int k = 0; k < 4; ++k) {
+            juce::FloatVectorOperations::addWithMultiply(destination, source + k, coefficients[k], numSamples);
+        }
+    }
+
+    inline void addFir6Baseline(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        for (int k = 0; k < 6; ++k) {
+            juce::FloatVectorOperations::addWithMultiply(destination, source + k, coefficients[k], numSamples);
+        }
+    }
+
+    inline void mixScalar(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            out[i] = dry[i] * dryGain + wet[i] * wetGain;
+        }
+    }
+
+    inline void addWithMultiplyScalar(float* destination, const float* source, float gain, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            destination[i] += source[i] * gain;
+        }
+    }
+
+    inline void addFir4Scalar(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            destination[i] += coefficients[0] * source[i] + coefficients[1] * source[i + 1]
+                + coefficients[2] * source[i + 2] + coefficients[3] * source[i + 3];
+        }
+    }
+
+    inline void addFir6Scalar(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            destination[i] += coefficients[0] * source[i] + coefficients[1] * source[i + 1]
+                + coefficients[2] * source[i + 2] + coefficients[3] * source[i + 3]
+                + coefficients[4] * source[i + 4] + coefficients[5] * source[i + 5];
+        }
+    }
+
+   #if JUCE_INTEL
+    //==============================================================================
+    MASTERSDELAY_TARGET("sse2")
+    inline void mixSSE2(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples)
+    {
+        auto dryGains = _mm_set1_ps(dryGain);
+        auto wetGains = _mm_set1_ps(wetGain);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4) {
+            auto result = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dry + i), dryGains), _mm_mul_ps(_mm_loadu_ps(wet + i), wetGains));
+            _mm_storeu_ps(out + i, result);
+        }
+
+        mixScalar(out + i, dry + i, dryGain, wet + i, wetGain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("sse2")
+    inline void addWithMultiplySSE2(float* destination, const float* source, float gain, int numSamples)
+    {
+        auto gains = _mm_set1_ps(gain);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4) {
+            auto result = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), gains));
+            _mm_storeu_ps(destination + i, result);
+        }
+
+        addWithMultiplyScalar(destination + i, source + i, gain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("sse2")
+    inline void addFir4SSE2(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm_set1_ps(coefficients[0]);
+        auto c1 = _mm_set1_ps(coefficients[1]);
+        auto c2 = _mm_set1_ps(coefficients[2]);
+        auto c3 = _mm_set1_ps(coefficients[3]);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4) {
+            auto sum = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i), c0), _mm_mul_ps(_mm_loadu_ps(source + i + 1), c1));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 2), c2), _mm_mul_ps(_mm_loadu_ps(source + i + 3), c3)));
+            _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), sum));
+        }
+
+        addFir4Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("sse2")
+    inline void addFir6SSE2(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm_set1_ps(coefficients[0]);
+        auto c1 = _mm_set1_ps(coefficients[1]);
+        auto c2 = _mm_set1_ps(coefficients[2]);
+        auto c3 = _mm_set1_ps(coefficients[3]);
+        auto c4 = _mm_set1_ps(coefficients[4]);
+        auto c5 = _mm_set1_ps(coefficients[5]);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4) {
+            auto sum = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i), c0), _mm_mul_ps(_mm_loadu_ps(source + i + 1), c1));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 2), c2), _mm_mul_ps(_mm_loadu_ps(source + i + 3), c3)));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 4), c4), _mm_mul_ps(_mm_loadu_ps(source + i + 5), c5)));
+            _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), sum));
+        }
+
+        addFir6Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+
+    //==============================================================================
+    MASTERSDELAY_TARGET("avx2")
+    inline void mixAVX2(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples)
+    {
+        auto dryGains = _mm256_set1_ps(dryGain);
+        auto wetGains = _mm256_set1_ps(wetGain);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8) {
+            auto result = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(dry + i), dryGains), _mm256_mul_ps(_mm256_loadu_ps(wet + i), wetGains));
+            _mm256_storeu_ps(out + i, result);
+        }
+
+        mixScalar(out + i, dry + i, dryGain, wet + i, wetGain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx2")
+    inline void addWithMultiplyAVX2(float* destination, const float* source, float gain, int numSamples)
+    {
+        auto gains = _mm256_set1_ps(gain);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8) {
+            auto result = _mm256_add_ps(_mm256_loadu_ps(destination + i), _mm256_mul_ps(_mm256_loadu_ps(source + i), gains));
+            _mm256_storeu_ps(destination + i, result);
+        }
+
+        addWithMultiplyScalar(destination + i, source + i, gain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx2")
+    inline void addFir4AVX2(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm256_set1_ps(coefficients[0]);
+        auto c1 = _mm256_set1_ps(coefficients[1]);
+        auto c2 = _mm256_set1_ps(coefficients[2]);
+        auto c3 = _mm256_set1_ps(coefficients[3]);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8) {
+            auto sum = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), c0), _mm256_mul_ps(_mm256_loadu_ps(source + i + 1), c1));
+            sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i + 2), c2), _mm256_mul_ps(_mm256_loadu_ps(source + i + 3), c3)));
+            _mm256_storeu_ps(destination + i, _mm256_add_ps(_mm256_loadu_ps(destination + i), sum));
+        }
+
+        addFir4Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx2")
+    inline void addFir6AVX2(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm256_set1_ps(coefficients[0]);
+        auto c1 = _mm256_set1_ps(coefficients[1]);
+        auto c2 = _mm256_set1_ps(coefficients[2]);
+        auto c3 = _mm256_set1_ps(coefficients[3]);
+        auto c4 = _mm256_set1_ps(coefficients[4]);
+        auto c5 = _mm256_set1_ps(coefficients[5]);
+        int i = 0;
+
+        for (; i + 8 <= numSamples; i += 8) {
+            auto sum = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), c0), _mm256_mul_ps(_mm256_loadu_ps(source + i + 1), c1));
+            sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i + 2), c2), _mm256_mul_ps(_mm256_loadu_ps(source + i + 3), c3)));
+            sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i + 4), c4), _mm256_mul_ps(_mm256_loadu_ps(source + i + 5), c5)));
+            _mm256_storeu_ps(destination + i, _mm256_add_ps(_mm256_loadu_ps(destination + i), sum));
+        }
+
+        addFir6Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+
+    //==============================================================================
+    MASTERSDELAY_TARGET("avx512f")
+    inline void mixAVX512(float* out, const float* dry, float dryGain, const float* wet, float wetGain, int numSamples)
+    {
+        auto dryGains = _mm512_set1_ps(dryGain);
+        auto wetGains = _mm512_set1_ps(wetGain);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16) {
+            auto result = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(dry + i), dryGains), _mm512_mul_ps(_mm512_loadu_ps(wet + i), wetGains));
+            _mm512_storeu_ps(out + i, result);
+        }
+
+        mixScalar(out + i, dry + i, dryGain, wet + i, wetGain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx512f")
+    inline void addWithMultiplyAVX512(float* destination, const float* source, float gain, int numSamples)
+    {
+        auto gains = _mm512_set1_ps(gain);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16) {
+            auto result = _mm512_add_ps(_mm512_loadu_ps(destination + i), _mm512_mul_ps(_mm512_loadu_ps(source + i), gains));
+            _mm512_storeu_ps(destination + i, result);
+        }
+
+        addWithMultiplyScalar(destination + i, source + i, gain, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx512f")
+    inline void addFir4AVX512(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm512_set1_ps(coefficients[0]);
+        auto c1 = _mm512_set1_ps(coefficients[1]);
+        auto c2 = _mm512_set1_ps(coefficients[2]);
+        auto c3 = _mm512_set1_ps(coefficients[3]);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16) {
+            auto sum = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(source + i), c0), _mm512_mul_ps(_mm512_loadu_ps(source + i + 1), c1));
+            sum = _mm512_add_ps(sum, _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(source + i + 2), c2), _mm512_mul_ps(_mm512_loadu_ps(source + i + 3), c3)));
+            _mm512_storeu_ps(destination + i, _mm512_add_ps(_mm512_loadu_ps(destination + i), sum));
+        }
+
+        addFir4Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+
+    MASTERSDELAY_TARGET("avx512f")
+    inline void addFir6AVX512(float* destination, const float* source, const float* coefficients, int numSamples)
+    {
+        auto c0 = _mm512_set1_ps(coefficients[0]);
+        auto c1 = _mm512_set1_ps(coefficients[1]);
+        auto c2 = _mm512_set1_ps(coefficients[2]);
+        auto c3 = _mm512_set1_ps(coefficients[3]);
+        auto c4 = _mm512_set1_ps(coefficients[4]);
+        auto c5 = _mm512_set1_ps(coefficients[5]);
+        int i = 0;
+
+        for (; i + 16 <= numSamples; i += 16) {
+            auto sum = _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(source + i), c0), _mm512_mul_ps(_mm512_loadu_ps(source + i + 1), c1));
+            sum = _mm512_add_ps(sum, _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(source + i + 2), c2), _mm512_mul_ps(_mm512_loadu_ps(source + i + 3), c3)));
+            sum = _mm512_add_ps(sum, _mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(source + i + 4), c4), _mm512_mul_ps(_mm512_loadu_ps(source + i + 5), c5)));
+            _mm512_storeu_ps(destination + i, _mm512_add_ps(_mm512_loadu_ps(destination + i), sum));
+        }
+
+        addFir6Scalar(destination + i, source + i, coefficients, numSamples - i);
+    }
+   #endif
+}
+
+inline SimdLevel getHighestSupportedSimdLevel()
+{
+   #if JUCE_INTEL
+    if (juce::SystemStats::hasAVX512F())
+        return SimdAVX512;
+    if (juce::SystemStats::hasAVX2())
+        return SimdAVX2;
+    if (juce::SystemStats::hasSSE2())
+        return SimdSSE2;
+   #endif
+
+    return SimdBaseline;
+}
+
+// Never returns a level above what the CPU supports
+inline const SimdKernels& getSimdKernels(SimdLevel requestedLevel)
+{
+    using namespace SimdKernelVariants;
+
+    static const SimdKernels kernels[] =
+    {
+        { SimdBaseline, "baseline", mixBaseline, addWithMultiplyBaseline, addFir4Baseline, addFir6Baseline },
+       #if JUCE_INTEL
+        { SimdSSE2, "sse2", mixSSE2, addWithMultiplySSE2, addFir4SSE2, addFir6SSE2 },
+        { SimdAVX2, "avx2", mixAVX2, addWithMultiplyAVX2, addFir4AVX2, addFir6AVX2 },
+        { SimdAVX512, "avx512", mixAVX512, addWithMultiplyAVX512, addFir4AVX512, addFir6AVX512 },
+       #endif
+    };
+
+    static const auto highestLevel = getHighestSupportedSimdLevel();
+    auto level = juce::jmin(requestedLevel, highestLevel);
+
+    return kernels[(size_t)level];
+}
+
+// The MASTERSDELAY_SIMD override, or the highest level if it is unset or unknown
+inline SimdLevel getRequestedSimdLevel()
+{
+    static const char* const levelNames[] = { "baseline", "sse2", "avx2", "avx512" };
+    auto requested = juce::SystemStats::getEnvironmentVariable("MASTERSDELAY_SIMD", {}).trim().toLowerCase();
+
+    for (int level = 0; level < NumSimdLevels; ++level) {
+        if (requested == levelNames[level])
+            return (SimdLevel)level;
+    }
+
+    return getHighestSupportedSimdLevel();
+}
\ No newline at end of file
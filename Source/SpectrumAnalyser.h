@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    Spectrum analyser for the editor. The audio thread only pushes samples,
+    the FFTs run on a dedicated thread and finished frames reach the GUI
+    through a triple buffer.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "TripleBuffer.h"
+
+struct SpectrumAnalyser : juce::Thread
+{
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int numBins = fftSize / 2;
+    static constexpr int hopSize = fftSize / 4;
+    static constexpr int ringSize = fftSize * 4;
+
+    struct Frame
+    {
+        std::array<float, numBins> input{};
+        std::array<float, numBins> wet{};
+        double sampleRate = 44100.0;
+    };
+
+    TripleBuffer<Frame> frames;
+
+    SpectrumAnalyser() : juce::Thread("Spectrum Analyser") {}
+
+    ~SpectrumAnalyser() override
+    {
+        stopThread(1000);
+    }
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate.store(newSampleRate);
+    }
+
+    void start()
+    {
+        active.store(true);
+        startThread();
+    }
+
+    void stop()
+    {
+        active.store(false);
+        stopThread(1000);
+    }
+
+    // Audio thread: one decision for both rings, so a block is either analysed
+    // on both or dropped on both when the analyser falls behind and the two
+    // spectra never drift apart. Free space only grows until the pushes.
+    bool canPush(int numSamples) const
+    {
+        return active.load(std::memory_order_relaxed)
+            && inputRing.getFreeSpace() >= numSamples && wetRing.getFreeSpace() >= numSamples;
+    }
+
+    // Audio thread, only after canPush accepted the block
+    void pushInput(const float* data, int numSamples)
+    {
+        writeToRing(inputRing, inputRingData, data, numSamples);
+    }
+
+    void pushWet(const float* data, int numSamples)
+    {
+        writeToRing(wetRing, wetRingData, data, numSamples);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            while (inputRing.getNumReady() >= hopSize && wetRing.getNumReady() >= hopSize)
+            {
+                readHop(inputRing, inputRingData, inputHistory);
+                readHop(wetRing, wetRingData, wetHistory);
+
+                auto& frame = frames.getWriteBuffer();
+                analyse(inputHistory, inputAverage, frame.input);
+                analyse(wetHistory, wetAverage, frame.wet);
+                frame.sampleRate = sampleRate.load();
+                frames.publish();
+            }
+
+            wait(20);
+        }
+    }
+
+private:
+    using Ring = std::array<float, ringSize>;
+    using History = std::array<float, fftSize>;
+    using Spectrum = std::array<float, numBins>;
+
+    static void writeToRing(juce::AbstractFifo& fifo, Ring& ringData, const float* data, int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+        std::copy_n(data, size1, ringData.begin() + start1);
+        std::copy_n(data + size1, size2, ringData.begin() + start2);
+
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    static void readHop(juce::AbstractFifo& fifo, Ring& ringData, History& history)
+    {
+        std::copy(history.begin() + hopSize, history.end(), history.begin());
+
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(hopSize, start1, size1, start2, size2);
+
+        auto* destination = history.data() + fftSize - hopSize;
+        std::copy_n(ringData.begin() + start1, size1, destination);
+        std::copy_n(ringData.begin() + start2, size2, destination + size1);
+
+        fifo.finishedRead(size1 + size2);
+    }
+
+    void analyse(const History& history, Spectrum& average, Spectrum& decibels)
+    {
+        std::copy(history.begin(), history.end(), fftData.begin());
+        std::fill(fftData.begin() + fftSize, fftData.end(), 0.0f);
+
+        window.multiplyWithWindowingTable(fftData.data(), (size_t)fftSize);
+        fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            auto magnitude = fftData[(size_t)bin] * (2.0f / (float)fftSize);
+            average[(size_t)bin] += averagingFactor * (magnitude - average[(size_t)bin]);
+            decibels[(size_t)bin] = juce::Decibels::gainToDecibels(average[(size_t)bin], minDecibels);
+        }
+    }
+
+    static constexpr float averagingFactor = 0.2f;
+    static constexpr float minDecibels = -100.0f;
+
+    juce::dsp::FFT fft{ fftOrder };
+    juce::dsp::WindowingFunction<float> window{ (size_t)fftSize, juce::dsp::WindowingFunction<float>::hann };
+    std::array<float, fftSize * 2> fftData{};
+
+    juce::AbstractFifo inputRing{ ringSize };
+    juce::AbstractFifo wetRing{ ringSize };
+    Ring inputRingData{};
+    Ring wetRingData{};
+
+    History inputHistory{};
+    History wetHistory{};
+    Spectrum inputAverage{};
+    Spectrum wetAverage{};
+
+    std::atomic<bool> active{ false };
+    std::atomic<double> sampleRate{ 44100.0 };
+};
@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    Lock-free handoff of the latest value from one producer thread to one
+    consumer thread. The producer never waits and the consumer always sees
+    a complete value, though it may skip values published in between.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+template <typename T>
+struct TripleBuffer
+{
+    // Producer
+    T& getWriteBuffer() { return buffers[(size_t)writeIndex]; }
+
+    void publish()
+    {
+        writeIndex = state.exchange(writeIndex | newDataBit) & indexMask;
+    }
+
+    // Consumer: returns true if a newer buffer has been swapped in
+    bool update()
+    {
+        if ((state.load() & newDataBit) == 0)
+            return false;
+
+        readIndex = state.exchange(readIndex) & indexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const { return buffers[(size_t)readIndex]; }
+
+private:
+    static constexpr int newDataBit = 4;
+    static constexpr int indexMask = 3;
+
+    std::array<T, 3> buffers{};
+    std::atomic<int> state{ 1 };
+    int writeIndex = 0;
+    int readIndex = 2;
+};
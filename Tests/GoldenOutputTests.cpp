@@ -0,0 +1,818 @@
+/*
+  ==============================================================================
+
+    Golden-output regression tests. Renders fixed impulse, sweep and noise
+    signals through the processor for every effect mode and a set of
+    parameter states, then compares each render with a reference file
+    recorded from the baseline build. Every render is also repeated with an
+    irregular host block size, which must not change a single sample, in
+    pipelined mode, which must give the same output one latency later, and
+    in real-time mode with the message loop running, under the real-time
+    safety audit, which must report no violations.
+
+    After the cases come scenarios that change something mid-render: a delay
+    time that needs pages the timer allocates and splices in, program
+    changes, and the decimated reverbs at 96 kHz and 192 kHz.
+
+    Cases that need parameters a build does not have are skipped. The
+    baseline references come from the harness in the commit that added
+    this directory; see README.md.
+
+    Usage:
+        GoldenOutputTests [--record] [--references <dir>]
+                          [--max-error <linear>] [--min-snr <dB>]
+                          [--case <name>]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include "../Source/PluginProcessor.h"
+#include "../Source/RealtimeAudit.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2;
+    constexpr int referenceBlockSize = 512;
+
+    // Deliberately odd sizes that never line up with the parameter tiles
+    const int irregularBlockSizes[] = { 1, 37, 509, 64, 250 };
+
+    struct ParameterValue
+    {
+        const char* parameterID;
+        float value;
+    };
+
+    // A named parameter state. Values are plain (denormalised); anything not
+    // listed keeps its default. Baseline cases only use parameters the
+    // baseline has, and must match its recorded references. The others
+    // cover later features: a reference pins them once recorded, and until
+    // then only the block-size check applies. Cases with an impulse
+    // response rate load a generated impulse response recorded at that rate.
+    struct TestCase
+    {
+        const char* name;
+        bool baseline;
+        std::vector<ParameterValue> parameters;
+        double impulseResponseRate = 0.0;
+    };
+
+    // Effects are off by default: the "On" parameters are bypass switches.
+    // Offline renders use the offline profile, so the live profile is copied
+    // into it for the cases that cover the live interpolation and LFO paths.
+    const std::vector<TestCase>& getTestCases()
+    {
+        static const std::vector<TestCase> testCases
+        {
+            { "Init", true, {} },
+            { "Slapback", true, { { "Delay Time", 0.12f }, { "Feedback", 0.1f }, { "Wet Level", 0.6f } } },
+            { "HighFeedback", true, { { "Delay Time", 0.25f }, { "Feedback", 0.9f } } },
+            { "Flanger", true, { { "Flanger On", 0.0f }, { "Flanger Feedback", 0.45f }, { "Flanger LFO Frequency", 0.2f } } },
+            { "Vibrato", true, { { "Vibrato On", 0.0f }, { "Vibrato Width", 0.008f }, { "Vibrato LFO Frequency", 1.2f } } },
+            { "Chorus", true, { { "Chorus On", 0.0f }, { "Number of Voices", 3.0f } } },
+            { "DryReverb", true, { { "Dry Reverb On", 0.0f }, { "Room Size", 0.4f } } },
+            { "WetReverb", true, { { "Wet Reverb On", 0.0f }, { "Wet Reverb", 0.7f }, { "Room Size", 0.45f }, { "Reverb Width", 1.0f } } },
+            { "AllEffects", true, { { "Flanger On", 0.0f }, { "Vibrato On", 0.0f }, { "Chorus On", 0.0f },
+                                    { "Dry Reverb On", 0.0f }, { "Wet Reverb On", 0.0f } } },
+            { "ReversedRouting", false, { { "Flanger On", 0.0f }, { "Chorus On", 0.0f }, { "Wet Reverb On", 0.0f },
+                                          { "Flanger Stage", 4.0f }, { "Vibrato Stage", 3.0f }, { "Chorus Stage", 2.0f }, { "Wet Reverb Stage", 1.0f } } },
+            { "FeedbackFilters", false, { { "Feedback", 0.6f }, { "Feedback High-Pass", 120.0f },
+                                          { "Feedback Low-Pass", 4500.0f }, { "Feedback Shelf", -6.0f } } },
+            { "PingPong", false, { { "Delay Time", 0.375f }, { "Feedback", 0.55f }, { "Feedback Mode", 2.0f } } },
+            { "CrossFeed", false, { { "Feedback Mode", 1.0f }, { "Cross Feed", 0.5f } } },
+            { "MultiTap", false, { { "Tap Count", 4.0f } } },
+            { "Granular", false, { { "Delay Mode", 1.0f }, { "Delay Time", 0.6f }, { "Feedback", 0.6f }, { "Grain Density", 8.0f } } },
+            { "GranularDown", false, { { "Delay Mode", 1.0f }, { "Grain Pitch", -12.0f }, { "Grain Size", 0.3f }, { "Grain Spray", 0.1f } } },
+            { "LiveProfile", false, { { "Flanger On", 0.0f }, { "Chorus On", 0.0f }, { "Wet Reverb On", 0.0f },
+                                      { "Offline Interpolation", 1.0f }, { "Offline LFO Resolution", 1.0f }, { "Offline Reverb Rate", 2.0f } } },
+            { "LinearProfile", false, { { "Vibrato On", 0.0f }, { "Wet Reverb On", 0.0f },
+                                        { "Offline Interpolation", 0.0f }, { "Offline LFO Resolution", 2.0f }, { "Offline Reverb Rate", 1.0f } } },
+            { "Convolution", false, { { "Reverb Type", 1.0f }, { "Wet Reverb On", 0.0f }, { "Wet Reverb", 0.7f } }, sampleRate },
+            { "ConvolutionResampled", false, { { "Reverb Type", 1.0f }, { "Dry Reverb On", 0.0f }, { "Wet Reverb On", 0.0f } }, 2.0 * sampleRate }
+        };
+
+        return testCases;
+    }
+
+    //==============================================================================
+    struct TestSignal
+    {
+        const char* name;
+        juce::AudioBuffer<float> buffer;
+    };
+
+    // Exponential sine sweep, 20 Hz to 20 kHz at -6 dBFS, identical on both
+    // channels so the dual-mono path is covered. A fade keeps the ends from
+    // splattering above 20 kHz.
+    juce::AudioBuffer<float> makeSweep(double rate, double fadeSeconds)
+    {
+        const double startFrequency = 20.0, endFrequency = 20000.0, sweepSeconds = 2.0;
+        const auto sweepLength = (int)(sweepSeconds * rate);
+        const auto fadeLength = (int)(fadeSeconds * rate);
+        const auto logRatio = std::log(endFrequency / startFrequency);
+
+        juce::AudioBuffer<float> sweep(numChannels, (int)((sweepSeconds + 2.0) * rate));
+        sweep.clear();
+
+        for (int sample = 0; sample < sweepLength; ++sample) {
+            auto time = sample / rate;
+            auto phase = juce::MathConstants<double>::twoPi * startFrequency * sweepSeconds / logRatio
+                * (std::exp(time * logRatio / sweepSeconds) - 1.0);
+
+            auto edge = juce::jmin(sample, sweepLength - 1 - sample);
+            auto fade = (edge < fadeLength) ? 0.5 - 0.5 * std::cos(juce::MathConstants<double>::pi * edge / fadeLength) : 1.0;
+
+            auto value = (float)(0.5 * fade * std::sin(phase));
+            sweep.setSample(0, sample, value);
+            sweep.setSample(1, sample, value);
+        }
+
+        return sweep;
+    }
+
+    // Three incommensurate sines at 48 kHz, smooth enough that a glitch stands out
+    float multiSine(int sample)
+    {
+        const double frequencies[] = { 97.0, 211.0, 313.0 };
+        double value = 0.0;
+
+        for (auto frequency : frequencies) {
+            value += 0.3 * std::sin(juce::MathConstants<double>::twoPi * frequency * sample / sampleRate);
+        }
+
+        return (float)value;
+    }
+
+    juce::AudioBuffer<float> makeMultiSine(double seconds)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, (int)(seconds * sampleRate));
+
+        for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                buffer.setSample(channel, sample, multiSine(sample));
+            }
+        }
+
+        return buffer;
+    }
+
+    // Each signal is followed by enough silence to hear the repeats decay
+    std::vector<TestSignal> makeTestSignals()
+    {
+        auto length = [](double seconds) { return (int)(seconds * sampleRate); };
+
+        std::vector<TestSignal> signals;
+
+        // A single click on the left only, so stereo and cross-feed paths show up
+        {
+            juce::AudioBuffer<float> impulse(numChannels, length(4.0));
+            impulse.clear();
+            impulse.setSample(0, 0, 1.0f);
+            signals.push_back({ "Impulse", std::move(impulse) });
+        }
+
+        // No fade, as recorded in the baseline references
+        signals.push_back({ "Sweep", makeSweep(sampleRate, 0.0) });
+
+        // One second of independent white noise per channel at -12 dBFS
+        {
+            juce::Random random(0x4d44);
+            juce::AudioBuffer<float> noise(numChannels, length(3.0));
+            noise.clear();
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                for (int sample = 0; sample < length(1.0); ++sample) {
+                    noise.setSample(channel, sample, 0.25f * (2.0f * random.nextFloat() - 1.0f));
+                }
+            }
+
+            signals.push_back({ "Noise", std::move(noise) });
+        }
+
+        return signals;
+    }
+
+    //==============================================================================
+    // References are 32-bit float WAV files, so they open in any editor
+    bool writeWav(const juce::File& file, const juce::AudioBuffer<float>& buffer, double rate = sampleRate)
+    {
+        file.deleteFile();
+
+        std::unique_ptr<juce::OutputStream> stream(file.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(stream.get(), rate,
+            (unsigned int)buffer.getNumChannels(), 32, {}, 0));
+
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+        return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+    }
+
+    bool readWav(const juce::File& file, juce::AudioBuffer<float>& buffer)
+    {
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatReader> reader(format.createReaderFor(file.createInputStream().release(), true));
+
+        if (reader == nullptr)
+            return false;
+
+        buffer.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
+        return reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, true);
+    }
+
+    // 1.5 s of seeded stereo noise decaying by 60 dB, long enough for the tail
+    // thread's partitions. Written to the temp directory at the given rate,
+    // so rates other than the session's go through the resampler.
+    juce::File getGeneratedImpulseResponse(double rate)
+    {
+        auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+            .getChildFile("MastersDelayTestIR_" + juce::String((int)rate) + ".wav");
+
+        juce::Random random(0x4952);
+        juce::AudioBuffer<float> impulse(numChannels, (int)(1.5 * rate));
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            for (int sample = 0; sample < impulse.getNumSamples(); ++sample) {
+                auto decay = std::pow(0.001, sample / (double)impulse.getNumSamples());
+                impulse.setSample(channel, sample, (float)(0.5 * decay * (2.0 * random.nextDouble() - 1.0)));
+            }
+        }
+
+        writeWav(file, impulse, rate);
+        return file;
+    }
+
+    //==============================================================================
+    // The first parameter of the case this build does not have, or nullptr
+    const char* findMissingParameter(const TestCase& testCase)
+    {
+        MastersDelayAudioProcessor processor;
+
+        for (auto& parameter : testCase.parameters) {
+            if (processor.apvts.getParameter(parameter.parameterID) == nullptr)
+                return parameter.parameterID;
+        }
+
+        return nullptr;
+    }
+
+    void setParameter(MastersDelayAudioProcessor& processor, const char* parameterID, float value)
+    {
+        auto* param = processor.apvts.getParameter(parameterID);
+        param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    // Lets the processor's timer run: page allocation, routing publication and logging
+    void runMessageLoop(int milliseconds)
+    {
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(milliseconds);
+    }
+
+    enum class RenderMode
+    {
+        offline,
+        live,
+        pipelined
+    };
+
+    // Called before each block with the processor and the block's first sample
+    using BlockHook = std::function<void(MastersDelayAudioProcessor&, int)>;
+
+    struct Render
+    {
+        juce::AudioBuffer<float> output;
+        int latency = 0;
+        bool governed = false;      // the load governor took a step, so the output depends on timing
+    };
+
+    // Offline is the deterministic tier: the load governor stays out of the
+    // way and delay pages are allocated in place. Pipelined renders are
+    // offline too, one latency behind.
+    //
+    // Live renders run real-time mode with the timer doing its job between
+    // blocks. A silent first block asks for the pages and routing the case
+    // needs; once the timer has provided them the processor is prepared
+    // again, so the render itself starts from the same state every time.
+    // Convolution renders keep to the real-time clock, as the tail thread
+    // is only guaranteed its head start there.
+    Render render(const TestCase& testCase, const juce::AudioBuffer<float>& input, const int* blockSizes, int numBlockSizes,
+                  RenderMode mode = RenderMode::offline, double rate = sampleRate, const BlockHook& beforeBlock = {})
+    {
+        MastersDelayAudioProcessor processor;
+
+        for (auto& parameter : testCase.parameters) {
+            setParameter(processor, parameter.parameterID, parameter.value);
+        }
+
+        if (mode == RenderMode::pipelined)
+            setParameter(processor, "Pipelined", 1.0f);
+
+        if (testCase.impulseResponseRate > 0.0)
+            processor.loadImpulseResponse(getGeneratedImpulseResponse(testCase.impulseResponseRate));
+
+        auto maxBlockSize = *std::max_element(blockSizes, blockSizes + numBlockSizes);
+        auto live = (mode == RenderMode::live);
+        auto paced = live && testCase.impulseResponseRate > 0.0;
+
+        processor.setNonRealtime(!live);
+        processor.setPlayConfigDetails(numChannels, numChannels, rate, maxBlockSize);
+        processor.prepareToPlay(rate, maxBlockSize);
+
+        juce::MidiBuffer midi;
+
+        if (live) {
+            juce::AudioBuffer<float> silence(numChannels, maxBlockSize);
+            silence.clear();
+            processor.processBlock(silence, midi);
+
+            runMessageLoop(200);
+            processor.prepareToPlay(rate, maxBlockSize);
+        }
+
+        Render result{ input, processor.getLatencySamples() };
+        auto& output = result.output;
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        for (int start = 0, block = 0; start < output.getNumSamples(); ++block) {
+            auto numSamples = juce::jmin(blockSizes[block % numBlockSizes], output.getNumSamples() - start);
+            juce::AudioBuffer<float> view(output.getArrayOfWritePointers(), numChannels, start, numSamples);
+
+            if (beforeBlock)
+                beforeBlock(processor, start);
+
+            processor.processBlock(view, midi);
+            start += numSamples;
+
+            if (live) {
+                result.governed = result.governed || processor.governor.level.load() != GovernorFullQuality;
+
+                auto due = startTime + 1000.0 * start / rate;
+                runMessageLoop(paced ? juce::jmax(1, (int)(due - juce::Time::getMillisecondCounterHiRes())) : 1);
+            }
+        }
+
+        processor.releaseResources();
+        return result;
+    }
+
+    Render render(const TestCase& testCase, const juce::AudioBuffer<float>& input, RenderMode mode = RenderMode::offline)
+    {
+        return render(testCase, input, &referenceBlockSize, 1, mode);
+    }
+
+    // The render as it would come out latency samples later
+    juce::AudioBuffer<float> delayed(const juce::AudioBuffer<float>& buffer, int latency)
+    {
+        juce::AudioBuffer<float> result(buffer.getNumChannels(), buffer.getNumSamples());
+        result.clear();
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+            if (latency < buffer.getNumSamples())
+                result.copyFrom(channel, latency, buffer, channel, 0, buffer.getNumSamples() - latency);
+        }
+
+        return result;
+    }
+
+    //==============================================================================
+    struct Comparison
+    {
+        float maxAbsError = 0.0f;
+        double snr = 0.0;
+        bool lengthMismatch = false;
+    };
+
+    // Signal-to-noise ratio of the reference against the difference; an exact
+    // match reports infinity
+    Comparison compare(const juce::AudioBuffer<float>& reference, const juce::AudioBuffer<float>& output)
+    {
+        Comparison comparison;
+
+        if (reference.getNumChannels() != output.getNumChannels() || reference.getNumSamples() != output.getNumSamples()) {
+            comparison.lengthMismatch = true;
+            return comparison;
+        }
+
+        double signalEnergy = 0.0, errorEnergy = 0.0;
+
+        for (int channel = 0; channel < reference.getNumChannels(); ++channel) {
+            auto* expected = reference.getReadPointer(channel);
+            auto* actual = output.getReadPointer(channel);
+
+            for (int sample = 0; sample < reference.getNumSamples(); ++sample) {
+                auto error = actual[sample] - expected[sample];
+
+                comparison.maxAbsError = juce::jmax(comparison.maxAbsError, std::abs(error));
+                signalEnergy += (double)expected[sample] * expected[sample];
+                errorEnergy += (double)error * error;
+            }
+        }
+
+        if (errorEnergy == 0.0)
+            comparison.snr = std::numeric_limits<double>::infinity();
+        else if (signalEnergy == 0.0)
+            comparison.snr = -std::numeric_limits<double>::infinity();
+        else
+            comparison.snr = 10.0 * std::log10(signalEnergy / errorEnergy);
+
+        return comparison;
+    }
+
+    //==============================================================================
+    struct Options
+    {
+        bool record = false;
+        juce::File references;
+        float maxError = 1.0e-4f;
+        double minSnr = 90.0;
+        juce::String onlyCase;
+    };
+
+    bool parseOptions(const juce::StringArray& args, Options& options)
+    {
+        options.references = juce::File(MASTERSDELAY_TEST_REFERENCES);
+
+        for (int i = 0; i < args.size(); ++i) {
+            auto arg = args[i];
+            auto hasValue = i + 1 < args.size();
+
+            if (arg == "--record")
+                options.record = true;
+            else if (arg == "--references" && hasValue)
+                options.references = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+            else if (arg == "--max-error" && hasValue)
+                options.maxError = args[++i].getFloatValue();
+            else if (arg == "--min-snr" && hasValue)
+                options.minSnr = args[++i].getDoubleValue();
+            else if (arg == "--case" && hasValue)
+                options.onlyCase = args[++i];
+            else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    juce::String formatSnr(double snr)
+    {
+        return std::isinf(snr) ? juce::String(snr > 0 ? "exact" : "-inf") : juce::String(snr, 1) + " dB";
+    }
+
+    juce::String formatComparison(const Comparison& comparison)
+    {
+        return comparison.lengthMismatch ? juce::String("length mismatch")
+            : juce::String(comparison.maxAbsError, 7) + " / " + formatSnr(comparison.snr);
+    }
+
+    bool passes(const Comparison& comparison, const Options& options)
+    {
+        return !comparison.lengthMismatch && comparison.maxAbsError <= options.maxError && comparison.snr >= options.minSnr;
+    }
+
+    // Compares a render with the reference of that name, or records it. Cases
+    // without a recorded reference pass unless they are baseline cases.
+    bool checkReference(const juce::File& file, const juce::AudioBuffer<float>& output, bool required,
+                        const Options& options, juce::String& result)
+    {
+        if (options.record) {
+            result = writeWav(file, output) ? "recorded" : "write failed";
+            return result == "recorded";
+        }
+
+        juce::AudioBuffer<float> reference;
+
+        if (!file.existsAsFile() || !readWav(file, reference)) {
+            result = required ? "missing" : "not recorded";
+            return !required;
+        }
+
+        auto comparison = compare(reference, output);
+        result = formatComparison(comparison);
+        return passes(comparison, options);
+    }
+
+    //==============================================================================
+    struct ScenarioResult
+    {
+        juce::String detail;
+        bool passed = false;
+    };
+
+    // Wet only, so every output sample is the input some whole number of samples
+    // ago. At one second the delay goes from 0.5 s to 0.75 s, past the single
+    // page that 0.5 s needs. Offline the page is allocated on the spot; live the
+    // delay holds at the committed length until the timer has allocated it.
+    // Either way the new page is spliced in at the write position, so the
+    // repeats carry on from the old ones: the only gap is the stretch of the
+    // longer delay that was never recorded, and nothing else is misread.
+    ScenarioResult runPagedSplice(RenderMode mode)
+    {
+        const TestCase testCase{ "PagedSplice", false, { { "Delay Time", 0.5f }, { "Feedback", 0.0f },
+                                                         { "Dry Level", 0.0f }, { "Wet Level", 1.0f } } };
+        const int changeAt = (int)sampleRate;
+        const int pageLength = 1 << DelayLineEffect::maxPageShift;
+        const int delays[] = { (int)(0.5 * sampleRate), pageLength - DelayLineEffect::guardSamples, (int)(0.75 * sampleRate) };
+
+        auto input = makeMultiSine(2.5);
+        bool changed = false;
+
+        auto output = render(testCase, input, &referenceBlockSize, 1, mode, sampleRate,
+            [&](MastersDelayAudioProcessor& processor, int start)
+            {
+                if (start >= changeAt && !changed) {
+                    setParameter(processor, "Delay Time", 0.75f);
+                    changed = true;
+                }
+            }).output;
+
+        // Each sample is silence or the input at one of the delays, give or take
+        // the interpolation kernel's reach; only the edges of a gap may be neither
+        constexpr float tolerance = 1.0e-3f;
+        constexpr int kernelReach = 4;
+        auto numSamples = output.getNumSamples();
+        std::vector<bool> silent((size_t)numSamples), matched((size_t)numSamples);
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            auto value = output.getSample(0, sample);
+            silent[(size_t)sample] = std::abs(value) < 1.0e-6f;
+
+            for (auto delay : delays) {
+                for (int offset = -kernelReach; offset <= kernelReach; ++offset) {
+                    auto source = sample - delay + offset;
+                    if (source >= 0 && std::abs(value - multiSine(source)) < tolerance)
+                        matched[(size_t)sample] = true;
+                }
+            }
+        }
+
+        int gapAfterChange = 0, misread = 0;
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            if (silent[(size_t)sample]) {
+                gapAfterChange += (sample >= changeAt) ? 1 : 0;
+                continue;
+            }
+
+            auto first = juce::jmax(0, sample - kernelReach), last = juce::jmin(numSamples - 1, sample + kernelReach);
+            auto nearGap = std::any_of(silent.begin() + first, silent.begin() + last + 1, [](bool isSilent) { return isSilent; });
+
+            if (!matched[(size_t)sample] && !nearGap)
+                ++misread;
+        }
+
+        const int allowedGap = delays[2] - pageLength + referenceBlockSize;
+
+        ScenarioResult result;
+        result.detail = juce::String(misread) + " misread, " + juce::String(gapAfterChange) + " silent (max " + juce::String(allowedGap) + ")";
+        result.passed = misread == 0 && gapAfterChange <= allowedGap;
+        return result;
+    }
+
+    // Programs with the same dry level, switched twice before any repeat can
+    // arrive: the dry signal must come through untouched while the engine fades.
+    ScenarioResult runProgramSwitch(RenderMode mode)
+    {
+        const TestCase testCase{ "ProgramSwitch", false, {} };
+        const int pingPong = 6, init = 0;
+        const int checkedLength = (int)(0.375 * sampleRate);
+
+        auto input = makeMultiSine(1.0);
+
+        auto output = render(testCase, input, &referenceBlockSize, 1, mode, sampleRate,
+            [&](MastersDelayAudioProcessor& processor, int start)
+            {
+                if (start == 10 * referenceBlockSize)
+                    processor.setCurrentProgram(pingPong);
+                else if (start == 20 * referenceBlockSize)
+                    processor.setCurrentProgram(init);
+            }).output;
+
+        float maxError = 0.0f;
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            for (int sample = 0; sample < checkedLength; ++sample) {
+                maxError = juce::jmax(maxError, std::abs(output.getSample(channel, sample) - input.getSample(channel, sample)));
+            }
+        }
+
+        ScenarioResult result;
+        result.detail = "dry error " + juce::String(maxError, 7);
+        result.passed = maxError <= 1.0e-5f;
+        return result;
+    }
+
+    struct SpectrumEnergy
+    {
+        double total = 0.0;
+        double above = 0.0;
+    };
+
+    // Energy of the first channel in all bins and in the bins above the given frequency
+    SpectrumEnergy measureSpectrum(const juce::AudioBuffer<float>& buffer, double rate, double frequency)
+    {
+        auto order = 1;
+        while ((1 << order) < buffer.getNumSamples()) {
+            ++order;
+        }
+
+        juce::dsp::FFT fft(order);
+        std::vector<float> data((size_t)(2 << order), 0.0f);
+        std::copy(buffer.getReadPointer(0), buffer.getReadPointer(0) + buffer.getNumSamples(), data.begin());
+        fft.performFrequencyOnlyForwardTransform(data.data());
+
+        SpectrumEnergy energy;
+        auto numBins = (1 << order) / 2 + 1;
+
+        for (int bin = 0; bin < numBins; ++bin) {
+            auto binEnergy = (double)data[(size_t)bin] * data[(size_t)bin];
+            energy.total += binEnergy;
+
+            if (bin * rate / (1 << order) > frequency)
+                energy.above += binEnergy;
+        }
+
+        return energy;
+    }
+
+    // The reverbs only run decimated at 88.2 kHz and up. Wet reverb only, on a
+    // sweep that stops at 20 kHz: the decimated render must keep the level of the
+    // full-rate one within the difference juce::Reverb's per-sample damping makes,
+    // add no images above the 24 kHz internal Nyquist, and not depend on the block size.
+    ScenarioResult runDecimation(double rate)
+    {
+        const std::vector<ParameterValue> wetReverb{ { "Dry Level", 0.0f }, { "Feedback", 0.3f },
+            { "Wet Reverb On", 0.0f }, { "Wet Reverb", 1.0f }, { "Room Size", 0.45f } };
+
+        auto decimatedCase = TestCase{ "Decimated", false, wetReverb };
+        decimatedCase.parameters.push_back({ "Offline Reverb Rate", 2.0f });
+        auto fullRateCase = TestCase{ "FullRate", false, wetReverb };
+        fullRateCase.parameters.push_back({ "Offline Reverb Rate", 0.0f });
+
+        auto input = makeSweep(rate, 0.01);
+        auto decimated = render(decimatedCase, input, &referenceBlockSize, 1, RenderMode::offline, rate).output;
+        auto irregular = render(decimatedCase, input, irregularBlockSizes, juce::numElementsInArray(irregularBlockSizes),
+            RenderMode::offline, rate).output;
+        auto fullRate = render(fullRateCase, input, &referenceBlockSize, 1, RenderMode::offline, rate).output;
+
+        constexpr double imageFrequency = 30000.0;
+        auto decimatedSpectrum = measureSpectrum(decimated, rate, imageFrequency);
+        auto fullRateSpectrum = measureSpectrum(fullRate, rate, imageFrequency);
+
+        auto levelDifference = 10.0 * std::log10(decimatedSpectrum.total / fullRateSpectrum.total);
+        auto images = 10.0 * std::log10(juce::jmax(1.0e-30, decimatedSpectrum.above - fullRateSpectrum.above) / decimatedSpectrum.total);
+        auto blockSizes = compare(decimated, irregular);
+
+        ScenarioResult result;
+        result.detail = "level " + juce::String(levelDifference, 2) + " dB, images " + juce::String(images, 1)
+            + " dB, block sizes " + formatComparison(blockSizes);
+        result.passed = std::abs(levelDifference) <= 2.0 && images <= -50.0
+            && !blockSizes.lengthMismatch && blockSizes.maxAbsError <= 1.0e-4f;
+        return result;
+    }
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i) {
+        args.add(argv[i]);
+    }
+
+    Options options;
+    if (!parseOptions(args, options))
+        return 2;
+
+    if (options.record && !options.references.createDirectory()) {
+        std::cerr << "Cannot create " << options.references.getFullPathName() << std::endl;
+        return 2;
+    }
+
+    auto signals = makeTestSignals();
+    int numFailures = 0, numRun = 0, numSkipped = 0;
+
+    std::cout << juce::String("case / signal").paddedRight(' ', 32)
+              << juce::String("reference").paddedRight(' ', 24)
+              << juce::String("block sizes").paddedRight(' ', 24)
+              << juce::String("pipelined").paddedRight(' ', 24)
+              << juce::String("live").paddedRight(' ', 24)
+              << juce::String("audit").paddedRight(' ', 12) << std::endl;
+
+    for (auto& testCase : getTestCases()) {
+        if (options.onlyCase.isNotEmpty() && options.onlyCase != testCase.name)
+            continue;
+
+        if (auto* missing = findMissingParameter(testCase)) {
+            std::cout << juce::String(testCase.name).paddedRight(' ', 32)
+                      << "skipped, this build has no \"" << missing << "\"" << std::endl;
+            ++numSkipped;
+            continue;
+        }
+
+        for (auto& signal : signals) {
+            auto name = juce::String(testCase.name) + "_" + signal.name;
+            ++numRun;
+
+            RealtimeAudit::resetViolationCount();
+
+            auto output = render(testCase, signal.buffer).output;
+            auto irregular = render(testCase, signal.buffer, irregularBlockSizes, juce::numElementsInArray(irregularBlockSizes)).output;
+            auto pipelined = render(testCase, signal.buffer, RenderMode::pipelined);
+            auto live = render(testCase, signal.buffer, RenderMode::live);
+
+            auto violations = RealtimeAudit::getViolationCount();
+            if (violations > 0)
+                RealtimeAudit::logViolations();
+
+            auto blockSizes = compare(output, irregular);
+            auto shifted = compare(delayed(output, pipelined.latency), pipelined.output);
+            auto passed = passes(blockSizes, options) && passes(shifted, options) && violations == 0;
+
+            juce::String referenceResult, liveResult;
+            passed = checkReference(options.references.getChildFile(name + ".wav"), output, testCase.baseline, options, referenceResult) && passed;
+
+            // Live references are never required; a governor step changes the
+            // quality mid-render, so that render is not compared
+            if (live.governed)
+                liveResult = "governed";
+            else
+                passed = checkReference(options.references.getChildFile(name + "_live.wav"), live.output, false, options, liveResult) && passed;
+
+            auto auditResult = (violations == 0) ? juce::String("clean") : juce::String(violations) + " violations";
+
+            std::cout << name.paddedRight(' ', 32)
+                      << referenceResult.paddedRight(' ', 24)
+                      << formatComparison(blockSizes).paddedRight(' ', 24)
+                      << formatComparison(shifted).paddedRight(' ', 24)
+                      << liveResult.paddedRight(' ', 24)
+                      << auditResult.paddedRight(' ', 12)
+                      << (passed ? "ok" : "FAIL") << std::endl;
+
+            if (!passed)
+                ++numFailures;
+        }
+    }
+
+    const std::vector<std::pair<juce::String, std::function<ScenarioResult()>>> scenarios
+    {
+        { "PagedSplice_Offline", [] { return runPagedSplice(RenderMode::offline); } },
+        { "PagedSplice_Live", [] { return runPagedSplice(RenderMode::live); } },
+        { "ProgramSwitch_Offline", [] { return runProgramSwitch(RenderMode::offline); } },
+        { "ProgramSwitch_Live", [] { return runProgramSwitch(RenderMode::live); } },
+        { "Decimation_96k", [] { return runDecimation(2.0 * sampleRate); } },
+        { "Decimation_192k", [] { return runDecimation(4.0 * sampleRate); } }
+    };
+
+    std::cout << std::endl << juce::String("scenario").paddedRight(' ', 32)
+              << juce::String("result").paddedRight(' ', 72)
+              << juce::String("audit").paddedRight(' ', 12) << std::endl;
+
+    for (auto& scenario : scenarios) {
+        if (options.onlyCase.isNotEmpty() && !scenario.first.startsWith(options.onlyCase))
+            continue;
+
+        ++numRun;
+        RealtimeAudit::resetViolationCount();
+
+        auto result = scenario.second();
+
+        auto violations = RealtimeAudit::getViolationCount();
+        if (violations > 0)
+            RealtimeAudit::logViolations();
+
+        auto passed = result.passed && violations == 0;
+        auto auditResult = (violations == 0) ? juce::String("clean") : juce::String(violations) + " violations";
+
+        std::cout << scenario.first.paddedRight(' ', 32)
+                  << result.detail.paddedRight(' ', 72)
+                  << auditResult.paddedRight(' ', 12)
+                  << (passed ? "ok" : "FAIL") << std::endl;
+
+        if (!passed)
+            ++numFailures;
+    }
+
+    std::cout << std::endl << (numRun - numFailures) << " of " << numRun << " renders and scenarios within "
+              << options.maxError << " max abs error and " << options.minSnr << " dB SNR, audit clean";
+
+    if (numSkipped > 0)
+        std::cout << ", " << numSkipped << " cases skipped";
+
+    std::cout << std::endl;
+
+    return numFailures == 0 ? 0 : 1;
+}